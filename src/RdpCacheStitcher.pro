@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -26,7 +26,26 @@ SOURCES += \
     tilestorewidget.cpp \
     recommendationslabel.cpp \
     aboutdialog.cpp \
-    notesdialog.cpp
+    notesdialog.cpp \
+    tilepixelpool.cpp \
+    compactimage.cpp \
+    screenexporter.cpp \
+    tilestoremodel.cpp \
+    tilestoredelegate.cpp \
+    tilebitset.cpp \
+    tileatlas.cpp \
+    screengrid.cpp \
+    recommendationlist.cpp \
+    tilemipmaps.cpp \
+    updatescheduler.cpp \
+    edgebenchmark.cpp \
+    scorerdialog.cpp \
+    edgeindex.cpp \
+    tileingestor.cpp \
+    bestfitmap.cpp \
+    locatedialog.cpp \
+    buddyclusterer.cpp \
+    clusterbenchmark.cpp
 
 HEADERS += \
         mainwindow.h \
@@ -36,12 +55,33 @@ HEADERS += \
     tilestorewidget.h \
     recommendationslabel.h \
     aboutdialog.h \
-    notesdialog.h
+    notesdialog.h \
+    tilepixelpool.h \
+    compactimage.h \
+    screenexporter.h \
+    tilestoremodel.h \
+    tilestoredelegate.h \
+    tilebitset.h \
+    tileatlas.h \
+    screengrid.h \
+    recommendationlist.h \
+    tilemipmaps.h \
+    updatescheduler.h \
+    edgebenchmark.h \
+    scorerdialog.h \
+    edgeindex.h \
+    tileingestor.h \
+    bestfitmap.h \
+    locatedialog.h \
+    buddyclusterer.h \
+    clusterbenchmark.h
 
 FORMS += \
         mainwindow.ui \
     aboutdialog.ui \
-    notesdialog.ui
+    notesdialog.ui \
+    scorerdialog.ui \
+    locatedialog.ui
 
 RC_ICONS = data/icon.ico
 
@@ -0,0 +1,387 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "bestfitmap.h"
+#include "screenlabel.h"
+
+#include <QtConcurrent>
+
+const int BestFitMap::CHUNK_SIZE = 512;
+
+BestFitMap::BestFitMap(TileStore *tileStore, QObject *parent)
+    : QObject(parent),
+      tileStore(tileStore),
+      grid(NULL),
+      enabled(false),
+      allDirty(true),
+      generation(0),
+      busy(false),
+      candidatesValid(false)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(jobFinished()));
+}
+
+BestFitMap::~BestFitMap()
+{
+    watcher.waitForFinished();
+}
+
+void BestFitMap::setGrid(const ScreenGrid *grid)
+{
+    this->grid = grid;
+    invalidateAll();
+}
+
+void BestFitMap::setEnabled(bool enabled)
+{
+    this->enabled = enabled;
+    invalidateAll();
+}
+
+bool BestFitMap::isEnabled() const
+{
+    return enabled;
+}
+
+BestFitMap::Fit BestFitMap::fit(QPoint cell) const
+{
+    Fit result = fits.value(cellKey(cell));
+    result.cell = cell;
+    return result;
+}
+
+void BestFitMap::invalidateAll()
+{
+    QVector<QPoint> changed;
+    for (auto it = fits.constBegin(); it != fits.constEnd(); ++it) {
+        if (it.value().index != -1) {
+            changed.append(it.value().cell);
+        }
+    }
+    fits.clear();
+    dirtyCells.clear();
+    pendingTiles.clear();
+    allDirty = true;
+    // Tile features change with the edge metric
+    candidates = Snapshot();
+    candidatesValid = false;
+    // A running job is discarded when it finishes
+    generation++;
+    if (!changed.isEmpty()) {
+        emit fitsChanged(changed);
+    }
+    startJob();
+}
+
+void BestFitMap::applyChanges(const TileChanges &changes)
+{
+    if (!enabled) {
+        return;
+    }
+    if (changes.allTiles) {
+        invalidateAll();
+        return;
+    }
+    QVector<QPoint> changed;
+    // Neighbours of a changed cell have a different frontier and different scores
+    const QPoint neighbours[] = {QPoint(0, 0), QPoint(-1, 0), QPoint(1, 0), QPoint(0, -1), QPoint(0, 1)};
+    foreach (QPoint cell, changes.cells) {
+        for (const QPoint &offset : neighbours) {
+            invalidateCell(cell + offset, &changed);
+        }
+    }
+    if (changes.firstInserted != -1 || !changes.visibility.isEmpty() || !changes.removed.isEmpty()) {
+        candidatesValid = false;
+    }
+    // New and reappearing tiles only need to be scored themselves
+    if (changes.firstInserted != -1) {
+        for (int i = changes.firstInserted; i < tileStore->size(); ++i) {
+            pendingTiles.insert(i);
+        }
+    }
+    QSet<int> gone;
+    foreach (int index, changes.visibility + changes.removed) {
+        if (tileStore->isCandidate(index)) {
+            pendingTiles.insert(index);
+        } else {
+            gone.insert(index);
+        }
+    }
+    // Cells whose best tile is no longer available are scored again
+    if (!gone.isEmpty()) {
+        QVector<QPoint> cells;
+        for (auto it = fits.constBegin(); it != fits.constEnd(); ++it) {
+            if (gone.contains(it.value().index)) {
+                cells.append(it.value().cell);
+            }
+        }
+        foreach (QPoint cell, cells) {
+            invalidateCell(cell, &changed);
+        }
+    }
+    if (!changed.isEmpty()) {
+        emit fitsChanged(changed);
+    }
+    startJob();
+}
+
+void BestFitMap::jobFinished()
+{
+    if (job.generation != generation) {
+        job = Job();
+        busy = false;
+        startJob();
+        return;
+    }
+    // Merge the best result of each cell; cells changed in the meantime are scored again anyway
+    QHash<quint64, Fit> results;
+    foreach (const WorkItem &item, job.items) {
+        const quint64 key = cellKey(item.result.cell);
+        if (dirtyCells.contains(key) || item.result.index == -1) {
+            continue;
+        }
+        auto it = results.find(key);
+        if (it == results.end() || item.result.score > it.value().score) {
+            results.insert(key, item.result);
+        }
+    }
+    job = Job();
+    QVector<QPoint> changed;
+    for (auto it = results.constBegin(); it != results.constEnd(); ++it) {
+        const Fit &result = it.value();
+        auto existing = fits.find(it.key());
+        if (existing == fits.end()) {
+            continue;
+        }
+        if (existing.value().index == -1 || result.score > existing.value().score) {
+            existing.value() = result;
+            changed.append(result.cell);
+        }
+    }
+    // Tiles may have been removed or hidden while the job was running
+    foreach (QPoint cell, changed) {
+        const int index = fits.value(cellKey(cell)).index;
+        if (!tileStore->isCandidate(index)) {
+            invalidateCell(cell, NULL);
+        }
+    }
+    if (!changed.isEmpty()) {
+        emit fitsChanged(changed);
+    }
+    busy = false;
+    startJob();
+}
+
+void BestFitMap::startJob()
+{
+    if (!enabled || grid == NULL || busy) {
+        // Dirty cells and pending tiles are picked up by the next job
+        return;
+    }
+    QVector<QPoint> cells;
+    if (allDirty) {
+        allDirty = false;
+        dirtyCells.clear();
+        pendingTiles.clear();
+        cells = frontier(*grid);
+    } else {
+        foreach (quint64 key, dirtyCells) {
+            const QPoint cell = cellOf(key);
+            if (isFrontier(*grid, cell)) {
+                cells.append(cell);
+            }
+        }
+        dirtyCells.clear();
+    }
+    QVector<int> newTiles;
+    foreach (int index, pendingTiles) {
+        if (index < tileStore->size() && tileStore->isCandidate(index)) {
+            newTiles.append(index);
+        }
+    }
+    pendingTiles.clear();
+    if (cells.isEmpty() && (newTiles.isEmpty() || fits.isEmpty())) {
+        return;
+    }
+    // Snapshot of everything the workers need, so the store and screen may change meanwhile
+    if (!candidatesValid) {
+        candidates = snapshot(tileStore, tileStore->candidates());
+        candidatesValid = true;
+    }
+    job = Job();
+    job.generation = generation;
+    job.scorer = ScreenLabel::g_scorers[ScreenLabel::Recommendations];
+    job.sourceStarts = tileStore->sourceStarts();
+    job.candidates = candidates;
+    job.newTiles = snapshot(tileStore, newTiles);
+    const int numCandidates = job.candidates.indices.size();
+    const int numTotal = numCandidates + job.newTiles.indices.size();
+    // Cells not scored yet against all candidates, the other ones against new tiles only
+    QSet<quint64> scored;
+    foreach (QPoint cell, cells) {
+        const quint64 key = cellKey(cell);
+        scored.insert(key);
+        Fit unknown;
+        unknown.cell = cell;
+        fits.insert(key, unknown);
+        for (int first = 0; first < numCandidates; first += CHUNK_SIZE) {
+            addItems(cell, first, qMin(CHUNK_SIZE, numCandidates - first));
+        }
+    }
+    if (!newTiles.isEmpty()) {
+        for (auto it = fits.constBegin(); it != fits.constEnd(); ++it) {
+            if (!scored.contains(it.key())) {
+                for (int first = numCandidates; first < numTotal; first += CHUNK_SIZE) {
+                    addItems(it.value().cell, first, qMin(CHUNK_SIZE, numTotal - first));
+                }
+            }
+        }
+    }
+    if (job.items.isEmpty()) {
+        job = Job();
+        return;
+    }
+    busy = true;
+    watcher.setFuture(QtConcurrent::map(job.items, [this](WorkItem &item) {
+        scoreItem(item, job);
+    }));
+}
+
+BestFitMap::Snapshot BestFitMap::snapshot(TileStore *tileStore, const QVector<int> &indices)
+{
+    Snapshot result;
+    result.indices = indices;
+    result.tiles.reserve(indices.size());
+    foreach (int index, indices) {
+        result.tiles.append(tileStore->getTile(index));
+    }
+    return result;
+}
+
+bool BestFitMap::isFrontier(const ScreenGrid &grid, QPoint cell)
+{
+    if (grid.at(cell.x(), cell.y()) != ScreenGrid::EMPTY) {
+        return false;
+    }
+    return grid.at(cell.x() - 1, cell.y()) >= 0 || grid.at(cell.x() + 1, cell.y()) >= 0
+            || grid.at(cell.x(), cell.y() - 1) >= 0 || grid.at(cell.x(), cell.y() + 1) >= 0;
+}
+
+QVector<QPoint> BestFitMap::frontier(const ScreenGrid &grid)
+{
+    QVector<QPoint> cells;
+    if (grid.isEmpty()) {
+        return cells;
+    }
+    const QRect area = grid.bounds().adjusted(-1, -1, 1, 1);
+    for (int row = area.top(); row <= area.bottom(); ++row) {
+        for (int col = area.left(); col <= area.right(); ++col) {
+            if (isFrontier(grid, QPoint(col, row))) {
+                cells.append(QPoint(col, row));
+            }
+        }
+    }
+    return cells;
+}
+
+void BestFitMap::copyNeighbours(const ScreenGrid &grid, QPoint cell, TileStore *tileStore, BestFitMap::Neighbour *neighbours)
+{
+    // The confidence factors depend on the order
+    const struct {
+        QPoint offset;
+        Tile::Edge edge;
+    } offsets[NUM_NEIGHBOURS] = {
+        {QPoint(-1, 0), Tile::Edge::Left},
+        {QPoint(1, 0), Tile::Edge::Right},
+        {QPoint(0, -1), Tile::Edge::Top},
+        {QPoint(0, 1), Tile::Edge::Bottom}
+    };
+    for (int n = 0; n < NUM_NEIGHBOURS; ++n) {
+        const QPoint p = cell + offsets[n].offset;
+        Neighbour &neighbour = neighbours[n];
+        neighbour.edge = offsets[n].edge;
+        neighbour.index = grid.at(p.x(), p.y());
+        neighbour.tile = (neighbour.index >= 0) ? tileStore->getTile(neighbour.index) : Tile();
+    }
+}
+
+double BestFitMap::scoreCell(Tile &tile, int index, BestFitMap::Neighbour *neighbours, Tile::Scorer scorer, const QVector<qint32> &sourceStarts)
+{
+    double matchValue = 0.0;
+    int numNeighbours = 0;
+    for (int n = 0; n < NUM_NEIGHBOURS; ++n) {
+        Neighbour &neighbour = neighbours[n];
+        if (neighbour.index < 0) {
+            continue;
+        }
+        numNeighbours++;
+        const int storeDistance = TileStore::storeDistance(index, neighbour.index, sourceStarts);
+        ScreenLabel::scoreNeighbour(tile, neighbour.tile, neighbour.edge, scorer, storeDistance, &matchValue);
+    }
+    return (numNeighbours > 0) ? matchValue/numNeighbours : 0.0;
+}
+
+void BestFitMap::addItems(QPoint cell, int first, int count)
+{
+    WorkItem item;
+    item.first = first;
+    item.count = count;
+    item.result.cell = cell;
+    copyNeighbours(*grid, cell, tileStore, item.neighbours);
+    job.items.append(item);
+}
+
+void BestFitMap::invalidateCell(QPoint cell, QVector<QPoint> *changed)
+{
+    const quint64 key = cellKey(cell);
+    auto it = fits.find(key);
+    if (it != fits.end()) {
+        if (it.value().index != -1 && changed != NULL) {
+            changed->append(cell);
+        }
+        fits.erase(it);
+    }
+    dirtyCells.insert(key);
+}
+
+void BestFitMap::scoreItem(BestFitMap::WorkItem &item, const BestFitMap::Job &job)
+{
+    const int numCandidates = job.candidates.indices.size();
+    for (int i = item.first; i < item.first + item.count; ++i) {
+        const Snapshot &source = (i < numCandidates) ? job.candidates : job.newTiles;
+        const int pos = (i < numCandidates) ? i : i - numCandidates;
+        const int index = source.indices.at(pos);
+        Tile tile = source.tiles.at(pos);
+        const double matchValue = scoreCell(tile, index, item.neighbours, job.scorer, job.sourceStarts);
+        if (matchValue > item.result.score) {
+            item.result.index = index;
+            item.result.score = matchValue;
+        }
+    }
+}
+
+quint64 BestFitMap::cellKey(QPoint cell)
+{
+    return (quint64(quint32(cell.x())) << 32) | quint64(quint32(cell.y()));
+}
+
+QPoint BestFitMap::cellOf(quint64 key)
+{
+    return QPoint(qint32(quint32(key >> 32)), qint32(quint32(key)));
+}
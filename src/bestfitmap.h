@@ -0,0 +1,182 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BESTFITMAP_H
+#define BESTFITMAP_H
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QSet>
+#include <QPoint>
+#include <QVector>
+
+#include "tilestore.h"
+#include "screengrid.h"
+#include "updatescheduler.h"
+
+//
+// Best scoring candidate tile for every empty frontier cell of a screen,
+// computed on all cores in the background. Jobs work on a snapshot of the
+// neighbour tiles and candidates. After placing, removing or adding tiles,
+// only the cells around changed cells are scored again, and only new tiles
+// are scored against the other cells.
+//
+class BestFitMap : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Fit {
+        QPoint cell;
+        //
+        // Best tile, or -1 if no candidate scores above zero
+        //
+        int index = -1;
+        double score = 0.0;
+    };
+    //
+    // Neighbour of an empty cell, copied for scoring in worker threads
+    //
+    struct Neighbour {
+        Tile::Edge edge;
+        int index = -1;
+        Tile tile;
+    };
+    static const int NUM_NEIGHBOURS = 4;
+    //
+    // Candidates scored for one cell by one work item
+    //
+    static const int CHUNK_SIZE;
+
+    BestFitMap(TileStore *tileStore, QObject *parent = 0);
+    ~BestFitMap();
+
+    //
+    // Screen to compute fits for; the grid must stay valid until it is
+    // replaced or reset to NULL
+    //
+    void setGrid(const ScreenGrid *grid);
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    //
+    // Best fit of a cell in grid coordinates; index is -1 if the cell is
+    // not a frontier cell or its fit is still being computed
+    //
+    Fit fit(QPoint cell) const;
+    //
+    // Score all frontier cells again, e.g. after the scorer changed
+    //
+    void invalidateAll();
+
+    //
+    // Empty cells of a grid with at least one placed neighbour
+    //
+    static bool isFrontier(const ScreenGrid &grid, QPoint cell);
+    static QVector<QPoint> frontier(const ScreenGrid &grid);
+    //
+    // Copy the neighbours of a cell, in the order ScreenLabel::calcMatchValue
+    // scores them
+    //
+    static void copyNeighbours(const ScreenGrid &grid, QPoint cell, TileStore *tileStore, Neighbour *neighbours);
+    //
+    // Same value as ScreenLabel::calcMatchValue, but on copied neighbours; thread-safe
+    //
+    static double scoreCell(Tile &tile, int index, Neighbour *neighbours, Tile::Scorer scorer, const QVector<qint32> &sourceStarts);
+
+public slots:
+    void applyChanges(const TileChanges &changes);
+
+signals:
+    //
+    // Fits of the cells changed, in grid coordinates
+    //
+    void fitsChanged(const QVector<QPoint> &cells);
+
+private slots:
+    void jobFinished();
+
+private:
+    //
+    // Scores candidates [first, first + count) of the job for one cell
+    //
+    struct WorkItem {
+        Neighbour neighbours[NUM_NEIGHBOURS];
+        int first = 0;
+        int count = 0;
+        Fit result;
+    };
+    //
+    // Copies of tiles for the workers. Never modified once built, so jobs
+    // share them until the store changes.
+    //
+    struct Snapshot {
+        QVector<int> indices;
+        QVector<Tile> tiles;
+    };
+    //
+    // Work items index the candidates first, then the new tiles
+    //
+    struct Job {
+        QVector<WorkItem> items;
+        Snapshot candidates;
+        Snapshot newTiles;
+        QVector<qint32> sourceStarts;
+        Tile::Scorer scorer;
+        int generation = 0;
+    };
+
+    TileStore *tileStore;
+    const ScreenGrid *grid;
+    bool enabled;
+    //
+    // Fits of all frontier cells scored so far, by cell key
+    //
+    QHash<quint64, Fit> fits;
+    //
+    // Work not started yet: everything, cells to score against all
+    // candidates, and tiles to score against all other cells
+    //
+    bool allDirty;
+    QSet<quint64> dirtyCells;
+    QSet<int> pendingTiles;
+    //
+    // Incremented whenever results of a running job become useless
+    //
+    int generation;
+    //
+    // Set from starting a job until its results have been merged; the
+    // watcher stops running before its finished signal is delivered
+    //
+    bool busy;
+    Job job;
+    QFutureWatcher<void> watcher;
+    Snapshot candidates;
+    bool candidatesValid;
+
+    void startJob();
+    static Snapshot snapshot(TileStore *tileStore, const QVector<int> &indices);
+    void addItems(QPoint cell, int first, int count);
+    void invalidateCell(QPoint cell, QVector<QPoint> *changed);
+    static void scoreItem(WorkItem &item, const Job &job);
+    static quint64 cellKey(QPoint cell);
+    static QPoint cellOf(quint64 key);
+};
+
+#endif // BESTFITMAP_H
@@ -0,0 +1,380 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "buddyclusterer.h"
+#include "mainwindow.h"
+
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <algorithm>
+
+const int BuddyClusterer::BUCKET_SHIFT = 5;
+const int BuddyClusterer::NUM_SEGMENTS = 16;
+const int BuddyClusterer::DETAIL_THRESHOLD = 16;
+const int BuddyClusterer::MAX_BUCKET_SIZE = 1000;
+const double BuddyClusterer::AMBIGUITY_MARGIN = 0.001;
+const int BuddyClusterer::MIN_FRAGMENT_SIZE = 4;
+const int BuddyClusterer::MAX_FRAGMENTS = 100;
+
+BuddyClusterer::BuddyClusterer(TileStore *tileStore, Tile::Scorer scorer)
+    : tileStore(tileStore),
+      scorer(scorer)
+{
+}
+
+QString BuddyClusterer::run(QVector<BuddyClusterer::Fragment> *fragments)
+{
+    // Solid tiles match anything of their color, placed tiles are already taken care of
+    indices.clear();
+    tiles.clear();
+    foreach (int index, tileStore->candidates()) {
+        if (!tileStore->isSolid(index) && tileStore->getUseCount(index) == 0) {
+            indices.append(index);
+            tiles.append(tileStore->getTile(index));
+        }
+    }
+    return cluster(fragments);
+}
+
+QString BuddyClusterer::run(const QVector<Tile> &tiles, QVector<BuddyClusterer::Fragment> *fragments)
+{
+    this->tiles = tiles;
+    indices.resize(tiles.size());
+    for (int t = 0; t < tiles.size(); ++t) {
+        indices[t] = t;
+    }
+    return cluster(fragments);
+}
+
+QString BuddyClusterer::cluster(QVector<BuddyClusterer::Fragment> *fragments)
+{
+    const int n = tiles.size();
+    if (n < 2) {
+        return "Not enough unused tiles to analyze!";
+    }
+    // Prefilter buckets by edge signature
+    const Tile::Filter filter = Tile::filterOf(scorer);
+    bucketKeys.resize(4*NUM_TABLES*n);
+    for (int table = 0; table < NUM_TABLES; ++table) {
+        for (int edge = 0; edge < 4; ++edge) {
+            buckets[table][edge].clear();
+        }
+    }
+    for (int t = 0; t < n; ++t) {
+        for (int edge = 0; edge < 4; ++edge) {
+            quint32 *keys = bucketKeys.data() + (4*t + edge)*NUM_TABLES;
+            edgeSignatures(tiles[t].getEdgeColors(Tile::Edge(edge), filter), keys);
+            for (int table = 0; table < NUM_TABLES; ++table) {
+                if (keys[table] != NO_BUCKET) {
+                    buckets[table][edge][keys[table]].append(t);
+                }
+            }
+        }
+    }
+    // Parallel stage: top K matches of every tile edge
+    topMatches.fill(Match(), 4*TOP_K*n);
+    numComparisons.fill(0, n);
+    QVector<int> order(n);
+    for (int t = 0; t < n; ++t) {
+        order[t] = t;
+    }
+    // Workers only read the tiles and each writes its own matches
+    Tile *tileData = tiles.data();
+    Match *matchData = topMatches.data();
+    int *comparisonData = numComparisons.data();
+    QFutureWatcher<void> watcher;
+    watcher.setFuture(QtConcurrent::map(order, [this, tileData, matchData, comparisonData](int &t) {
+        comparisonData[t] = findMatches(t, tileData, matchData);
+    }));
+    if (!MainWindow::runWithProgress("Finding best buddies...", watcher)) {
+        return "Cancelled";
+    }
+    // Sequential stage: join mutual best buddies, strongest first
+    QVector<Pair> pairs = mutualPairs();
+    std::sort(pairs.begin(), pairs.end(), [](const Pair &a, const Pair &b) {
+        return a.score > b.score;
+    });
+    numPairs = pairs.size();
+    numJoined = 0;
+    numCollisions = 0;
+    rootOf.resize(n);
+    positions.fill(QPoint(0, 0), n);
+    members.clear();
+    cells.clear();
+    for (int t = 0; t < n; ++t) {
+        rootOf[t] = t;
+    }
+    foreach (const Pair &pair, pairs) {
+        const QPoint offset = (pair.edge == Tile::Right) ? QPoint(1, 0) : QPoint(0, 1);
+        if (rootOf.at(pair.tile) == rootOf.at(pair.buddy)) {
+            continue;
+        }
+        if (join(pair.tile, pair.buddy, offset)) {
+            numJoined++;
+        } else {
+            numCollisions++;
+        }
+    }
+    // Large fragments, with their top left cell at (0, 0)
+    fragments->clear();
+    for (auto it = members.constBegin(); it != members.constEnd(); ++it) {
+        if (it.value().size() < MIN_FRAGMENT_SIZE) {
+            continue;
+        }
+        Fragment fragment;
+        QPoint topLeft(INT_MAX, INT_MAX);
+        foreach (int t, it.value()) {
+            topLeft.setX(qMin(topLeft.x(), positions.at(t).x()));
+            topLeft.setY(qMin(topLeft.y(), positions.at(t).y()));
+        }
+        foreach (int t, it.value()) {
+            fragment.tiles.append(indices.at(t));
+            fragment.positions.append(positions.at(t) - topLeft);
+        }
+        fragments->append(fragment);
+    }
+    std::sort(fragments->begin(), fragments->end(), [](const Fragment &a, const Fragment &b) {
+        return a.tiles.size() > b.tiles.size();
+    });
+    numFragments = fragments->size();
+    if (fragments->size() > MAX_FRAGMENTS) {
+        fragments->resize(MAX_FRAGMENTS);
+    }
+    return "";
+}
+
+QString BuddyClusterer::report() const
+{
+    qint64 comparisons = 0;
+    foreach (int count, numComparisons) {
+        comparisons += count;
+    }
+    const double perEdge = tiles.isEmpty() ? 0.0 : double(comparisons)/(4*tiles.size());
+    return QString("Tiles analyzed: ") + QString::number(tiles.size()) + "\n"
+            + "Edge comparisons: " + QString::number(comparisons) + " ("
+            + QString::number(perEdge, 'f', 1) + " per edge instead of " + QString::number(tiles.size() - 1) + ")\n"
+            + "Mutual best buddies: " + QString::number(numPairs) + ", "
+            + QString::number(numJoined) + " joined, " + QString::number(numCollisions) + " rejected as overlapping\n"
+            + "Fragments with at least " + QString::number(MIN_FRAGMENT_SIZE) + " tiles: " + QString::number(numFragments);
+}
+
+int BuddyClusterer::findMatches(int t, Tile *tileData, BuddyClusterer::Match *matchData)
+{
+    Tile &tile = tileData[t];
+    int comparisons = 0;
+    for (int edge = 0; edge < 4; ++edge) {
+        const Tile::Edge otherEdge = tile.oppositeEdge(Tile::Edge(edge));
+        Match *matches = matchData + (4*t + edge)*TOP_K;
+        const int levels = 255 >> BUCKET_SHIFT;
+        for (int table = 0; table < NUM_TABLES; ++table) {
+            const quint32 key = bucketKeys.at((4*t + edge)*NUM_TABLES + table);
+            if (key == NO_BUCKET) {
+                continue;
+            }
+            const QHash<quint32, QVector<int>> &tableBuckets = buckets[table][otherEdge];
+            const quint32 pattern = key & ((1u << COLOR_SHIFT) - 1);
+            const quint32 color = key >> COLOR_SHIFT;
+            // Same pattern, same and adjacent mean color buckets in every channel
+            for (int dr = -1; dr <= 1; ++dr) {
+                for (int dg = -1; dg <= 1; ++dg) {
+                    for (int db = -1; db <= 1; ++db) {
+                        const int red = int(color >> 6) + dr;
+                        const int green = int((color >> 3) & 7) + dg;
+                        const int blue = int(color & 7) + db;
+                        if (red < 0 || green < 0 || blue < 0 || red > levels || green > levels || blue > levels) {
+                            continue;
+                        }
+                        const quint32 otherColor = (quint32(red) << 6) | (quint32(green) << 3) | quint32(blue);
+                        auto it = tableBuckets.constFind((otherColor << COLOR_SHIFT) | pattern);
+                        if (it == tableBuckets.constEnd() || it.value().size() > MAX_BUCKET_SIZE) {
+                            continue;
+                        }
+                        foreach (int u, it.value()) {
+                            // Edges matching in several tables are scored once
+                            if (u == t || hasMatch(matches, u)) {
+                                continue;
+                            }
+                            const double score = tile.calcEdgeScore(tileData[u], scorer, Tile::Edge(edge));
+                            insertMatch(matches, u, float(score));
+                            comparisons++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return comparisons;
+}
+
+bool BuddyClusterer::hasMatch(const BuddyClusterer::Match *matches, int tile)
+{
+    for (int k = 0; k < TOP_K; ++k) {
+        if (matches[k].tile == tile) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BuddyClusterer::insertMatch(BuddyClusterer::Match *matches, int tile, float score)
+{
+    if (matches[TOP_K - 1].tile != -1 && score <= matches[TOP_K - 1].score) {
+        return;
+    }
+    int k = TOP_K - 1;
+    while (k > 0 && (matches[k - 1].tile == -1 || matches[k - 1].score < score)) {
+        matches[k] = matches[k - 1];
+        --k;
+    }
+    matches[k].tile = tile;
+    matches[k].score = score;
+}
+
+bool BuddyClusterer::isUnambiguous(int t, Tile::Edge edge) const
+{
+    const Match *matches = topMatches.constData() + (4*t + edge)*TOP_K;
+    if (matches[0].tile == -1 || matches[0].score < TileStore::QUALITY_THRESHOLD) {
+        return false;
+    }
+    // The bottom edge of a resized tile is padding
+    if (edge == Tile::Bottom && tiles.at(t).isResized) {
+        return false;
+    }
+    return matches[1].tile == -1 || matches[0].score - matches[1].score > AMBIGUITY_MARGIN;
+}
+
+QVector<BuddyClusterer::Pair> BuddyClusterer::mutualPairs() const
+{
+    QVector<Pair> pairs;
+    const Tile::Edge edges[] = {Tile::Right, Tile::Bottom};
+    for (int t = 0; t < tiles.size(); ++t) {
+        for (Tile::Edge edge : edges) {
+            if (!isUnambiguous(t, edge)) {
+                continue;
+            }
+            const Match &best = topMatches.at((4*t + edge)*TOP_K);
+            const Tile::Edge otherEdge = tiles.at(t).oppositeEdge(edge);
+            if (!isUnambiguous(best.tile, otherEdge)) {
+                continue;
+            }
+            const Match &back = topMatches.at((4*best.tile + otherEdge)*TOP_K);
+            if (back.tile == t) {
+                Pair pair;
+                pair.tile = t;
+                pair.buddy = best.tile;
+                pair.edge = edge;
+                pair.score = qMin(best.score, back.score);
+                pairs.append(pair);
+            }
+        }
+    }
+    return pairs;
+}
+
+bool BuddyClusterer::join(int tile, int buddy, QPoint offset)
+{
+    int root = rootOf.at(tile);
+    int other = rootOf.at(buddy);
+    // Shift that moves the buddy's fragment into the tile's frame
+    QPoint shift = positions.at(tile) + offset - positions.at(buddy);
+    // Move the smaller fragment
+    const int rootSize = members.contains(root) ? members.value(root).size() : 1;
+    const int otherSize = members.contains(other) ? members.value(other).size() : 1;
+    if (otherSize > rootSize) {
+        std::swap(root, other);
+        shift = -shift;
+    }
+    QHash<quint64, int> &target = cellsOf(root);
+    const QVector<int> moved = members.contains(other) ? members.value(other) : QVector<int>() << other;
+    foreach (int t, moved) {
+        if (target.contains(cellKey(positions.at(t) + shift))) {
+            return false;
+        }
+    }
+    QVector<int> &rootMembers = members[root];
+    if (rootMembers.isEmpty()) {
+        rootMembers.append(root);
+    }
+    foreach (int t, moved) {
+        positions[t] += shift;
+        rootOf[t] = root;
+        rootMembers.append(t);
+        target.insert(cellKey(positions.at(t)), t);
+    }
+    members.remove(other);
+    cells.remove(other);
+    return true;
+}
+
+QHash<quint64, int> &BuddyClusterer::cellsOf(int root)
+{
+    // Single tiles have no cell table until they are joined
+    if (!cells.contains(root)) {
+        cells[root].insert(cellKey(positions.at(root)), root);
+    }
+    return cells[root];
+}
+
+void BuddyClusterer::edgeSignatures(const QVector<Tile::AvgColor> &colors, quint32 *keys)
+{
+    const int length = colors.size();
+    double red = 0.0;
+    double green = 0.0;
+    double blue = 0.0;
+    foreach (const Tile::AvgColor &color, colors) {
+        red += color.red;
+        green += color.green;
+        blue += color.blue;
+    }
+    const int count = qMax(length, 1);
+    const quint32 r = quint32(qBound(0, int(red/count), 255)) >> BUCKET_SHIFT;
+    const quint32 g = quint32(qBound(0, int(green/count), 255)) >> BUCKET_SHIFT;
+    const quint32 b = quint32(qBound(0, int(blue/count), 255)) >> BUCKET_SHIFT;
+    const quint32 color = (r << 6) | (g << 3) | b;
+    const double gray = (red + green + blue)/(3*count);
+    // Two bits per segment: darker or lighter than the edge as a whole
+    quint32 patterns[NUM_TABLES] = {};
+    const int segments = qMin(NUM_SEGMENTS, length);
+    for (int segment = 0; segment < segments; ++segment) {
+        const int begin = segment*length/segments;
+        const int end = (segment + 1)*length/segments;
+        double sum = 0.0;
+        for (int i = begin; i < end; ++i) {
+            const Tile::AvgColor &c = colors.at(i);
+            sum += c.red + c.green + c.blue;
+        }
+        const double segmentGray = sum/(3*(end - begin));
+        quint32 bits = 0;
+        if (segmentGray < gray - DETAIL_THRESHOLD) {
+            bits = 1;
+        } else if (segmentGray > gray + DETAIL_THRESHOLD) {
+            bits = 2;
+        }
+        quint32 &pattern = patterns[segment % NUM_TABLES];
+        pattern |= bits << (2*(segment/NUM_TABLES));
+    }
+    for (int table = 0; table < NUM_TABLES; ++table) {
+        keys[table] = (patterns[table] == 0) ? NO_BUCKET : ((color << COLOR_SHIFT) | patterns[table]);
+    }
+}
+
+quint64 BuddyClusterer::cellKey(QPoint cell)
+{
+    return (quint64(quint32(cell.x())) << 32) | quint64(quint32(cell.y()));
+}
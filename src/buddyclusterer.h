@@ -0,0 +1,185 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUDDYCLUSTERER_H
+#define BUDDYCLUSTERER_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QPoint>
+
+#include "tilestore.h"
+
+//
+// Finds groups of tiles that belong together without any placed tile to
+// start from. For every edge of every unused tile, the best scoring edges
+// of the other tiles are kept (top K, no pairwise matrix). Edges that are
+// each other's unambiguous best match (mutual best buddies) are joined,
+// strongest first, into fragments with relative tile positions. Candidate
+// edges are prefiltered by an edge signature, so the store is not scanned
+// for every edge: the coarse mean color plus the pattern of segments that
+// are clearly darker or lighter than that mean. Every edge has a signature
+// per table, each built from every NUM_TABLES-th segment, and two
+// edges are compared if any of their signatures match. Signatures shared by
+// more than MAX_BUCKET_SIZE edges are too common to lead to an unambiguous
+// match and are not scanned, which bounds the work per edge.
+//
+class BuddyClusterer
+{
+public:
+    //
+    // Matches kept per tile edge: the best one and the runner-up, which
+    // shows if the best one is ambiguous
+    //
+    static const int TOP_K = 2;
+    //
+    // Signature tables; table i uses the segments i, i + NUM_TABLES, ...
+    //
+    static const int NUM_TABLES = 4;
+    //
+    // Low bits dropped from each channel of the mean edge color; candidate
+    // edges must be in the same or an adjacent bucket
+    //
+    static const int BUCKET_SHIFT;
+    //
+    // Segments along an edge, and how far the mean gray level of a segment
+    // must be from the one of the edge to count as darker or lighter
+    //
+    static const int NUM_SEGMENTS;
+    static const int DETAIL_THRESHOLD;
+    //
+    // Larger buckets are skipped
+    //
+    static const int MAX_BUCKET_SIZE;
+    //
+    // The best match must beat the runner-up by this score difference
+    //
+    static const double AMBIGUITY_MARGIN;
+    //
+    // Smaller fragments are not returned, and at most MAX_FRAGMENTS of them
+    //
+    static const int MIN_FRAGMENT_SIZE;
+    static const int MAX_FRAGMENTS;
+
+    //
+    // Tiles with their cell positions, top left cell at (0, 0)
+    //
+    struct Fragment {
+        QVector<int> tiles;
+        QVector<QPoint> positions;
+    };
+
+    BuddyClusterer(TileStore *tileStore, Tile::Scorer scorer);
+
+    //
+    // Analyze all unused, non-solid candidate tiles of the store. Fragments
+    // are sorted by size, largest first. Returns an error message or an
+    // empty string.
+    //
+    QString run(QVector<Fragment> *fragments);
+    //
+    // Analyze the given tiles instead of the store; fragments refer to
+    // positions in tiles
+    //
+    QString run(const QVector<Tile> &tiles, QVector<Fragment> *fragments);
+    QString report() const;
+
+private:
+    struct Match {
+        //
+        // Position in tiles, -1 if unused
+        //
+        int tile = -1;
+        float score = 0.0f;
+    };
+    struct Pair {
+        int tile;
+        int buddy;
+        //
+        // Edge of tile facing buddy, Right or Bottom
+        //
+        Tile::Edge edge;
+        float score;
+    };
+
+    TileStore *tileStore;
+    Tile::Scorer scorer;
+    //
+    // Store indices and features of the analyzed tiles
+    //
+    QVector<int> indices;
+    QVector<Tile> tiles;
+    //
+    // Signatures of each tile edge per table, and tiles by signature per
+    // table and edge. Edges without any darker or lighter segment in a table
+    // match too many others to be unambiguous and get NO_BUCKET there.
+    //
+    QVector<quint32> bucketKeys;
+    QHash<quint32, QVector<int>> buckets[NUM_TABLES][4];
+    //
+    // TOP_K matches per tile edge
+    //
+    QVector<Match> topMatches;
+    QVector<int> numComparisons;
+    //
+    // Union by size: members of each fragment root and positions relative
+    // to the root, so a merged fragment can be moved into the other's frame
+    //
+    QVector<int> rootOf;
+    QVector<QPoint> positions;
+    QHash<int, QVector<int>> members;
+    QHash<int, QHash<quint64, int>> cells;
+    int numPairs = 0;
+    int numJoined = 0;
+    int numCollisions = 0;
+    int numFragments = 0;
+
+    static const quint32 NO_BUCKET = 0xffffffffu;
+    //
+    // Signature layout: segment pattern in the low bits, two bits per
+    // segment, coarse mean color above with 255 >> BUCKET_SHIFT in 3 bits
+    // per channel
+    //
+    static const int COLOR_SHIFT = 16;
+
+    QString cluster(QVector<Fragment> *fragments);
+
+    //
+    // Returns the number of edge comparisons
+    //
+    int findMatches(int t, Tile *tileData, Match *matchData);
+    static void insertMatch(Match *matches, int tile, float score);
+    bool isUnambiguous(int t, Tile::Edge edge) const;
+    QVector<Pair> mutualPairs() const;
+    //
+    // Join the fragments of tile and buddy so that buddy is at offset from
+    // tile. Returns false if their cells would overlap.
+    //
+    bool join(int tile, int buddy, QPoint offset);
+    QHash<quint64, int> &cellsOf(int root);
+    //
+    // Store the signature of each table in keys
+    //
+    static void edgeSignatures(const QVector<Tile::AvgColor> &colors, quint32 *keys);
+    static bool hasMatch(const Match *matches, int tile);
+    static quint64 cellKey(QPoint cell);
+};
+
+#endif // BUDDYCLUSTERER_H
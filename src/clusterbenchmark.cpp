@@ -0,0 +1,151 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "clusterbenchmark.h"
+#include "buddyclusterer.h"
+#include "mainwindow.h"
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QHash>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+QString ClusterBenchmark::run(int numTiles, int tileSize, Tile::Scorer scorer)
+{
+    const int numCols = qMax(1, int(std::ceil(std::sqrt(double(numTiles)))));
+    // Shuffled, so the input order tells nothing about the layout
+    QVector<QPoint> layout(numTiles);
+    for (int t = 0; t < numTiles; ++t) {
+        layout[t] = QPoint(t % numCols, t / numCols);
+    }
+    std::mt19937 random(1);
+    std::shuffle(layout.begin(), layout.end(), random);
+    QElapsedTimer timer;
+    timer.start();
+    QVector<Tile> tiles(numTiles);
+    QVector<int> order(numTiles);
+    for (int t = 0; t < numTiles; ++t) {
+        order[t] = t;
+    }
+    Tile *tileData = tiles.data();
+    const QPoint *layoutData = layout.constData();
+    QFutureWatcher<void> watcher;
+    // The compact metric keeps the features of all tiles in memory; the
+    // store and its metric are left alone
+    watcher.setFuture(QtConcurrent::map(order, [tileData, layoutData, tileSize](int &t) {
+        Tile tile(desktopTile(layoutData[t], tileSize), false, false, Tile::Sad);
+        tile.dropImage();
+        tileData[t] = tile;
+    }));
+    if (!MainWindow::runWithProgress("Creating tiles...", watcher)) {
+        return "Cancelled";
+    }
+    const qint64 createMs = timer.restart();
+    BuddyClusterer clusterer(NULL, scorer);
+    QVector<BuddyClusterer::Fragment> fragments;
+    const QString error = clusterer.run(tiles, &fragments);
+    if (!error.isEmpty()) {
+        return error;
+    }
+    const qint64 clusterMs = timer.elapsed();
+    // A neighbour in a fragment is correct if it has the same offset on screen
+    int numNeighbours = 0;
+    int numCorrect = 0;
+    foreach (const BuddyClusterer::Fragment &fragment, fragments) {
+        QHash<quint64, int> byCell;
+        for (int i = 0; i < fragment.tiles.size(); ++i) {
+            const QPoint cell = fragment.positions.at(i);
+            byCell.insert((quint64(quint32(cell.x())) << 32) | quint32(cell.y()), fragment.tiles.at(i));
+        }
+        for (int i = 0; i < fragment.tiles.size(); ++i) {
+            const QPoint cell = fragment.positions.at(i);
+            const QPoint offsets[] = {QPoint(1, 0), QPoint(0, 1)};
+            for (const QPoint &offset : offsets) {
+                const QPoint other = cell + offset;
+                auto it = byCell.constFind((quint64(quint32(other.x())) << 32) | quint32(other.y()));
+                if (it == byCell.constEnd()) {
+                    continue;
+                }
+                numNeighbours++;
+                if (layout.at(it.value()) - layout.at(fragment.tiles.at(i)) == offset) {
+                    numCorrect++;
+                }
+            }
+        }
+    }
+    return QString("Best buddy clustering of ") + QString::number(numTiles) + " synthetic "
+            + QString::number(tileSize) + "x" + QString::number(tileSize) + " desktop tiles\n\n"
+            + "Creating tiles: " + QString::number(createMs/1000.0, 'f', 1) + " s\n"
+            + "Clustering: " + QString::number(clusterMs/1000.0, 'f', 1) + " s\n\n"
+            + clusterer.report() + "\n\n"
+            + "Correct neighbours in the " + QString::number(fragments.size()) + " largest fragments: "
+            + QString::number(numCorrect) + " of " + QString::number(numNeighbours);
+}
+
+QRgb ClusterBenchmark::desktopPixel(int x, int y)
+{
+    // Windows of 640 x 480 pixels with a colored title bar
+    const int windowX = x/640;
+    const int windowY = y/480;
+    const int inWindowY = y % 480;
+    const quint32 window = mix(windowX, windowY, 0);
+    if (inWindowY < 24) {
+        const int shade = int((x % 640)*32/640);
+        return qRgb(int(window & 0x3f) + shade, int((window >> 8) & 0x7f) + shade, 160 + int((window >> 16) & 0x3f));
+    }
+    // Lines of dark glyphs on a near-white background
+    const int line = inWindowY/16;
+    const int inLine = inWindowY % 16;
+    // Glyphs are 7 pixels wide, so some of them cross tile boundaries
+    const int glyph = x/7;
+    const quint32 glyphHash = mix(glyph, line, window);
+    const bool hasGlyph = (glyphHash % 100) < 70 && (mix(glyph/12, line, window) % 4) != 0;
+    if (hasGlyph && inLine >= 3 && inLine < 13 && (x % 7) < 5) {
+        const quint32 bit = mix(glyphHash, (x % 7)/2, (inLine - 3)/2) & 1;
+        if (bit) {
+            return qRgb(30, 30, 40);
+        }
+    }
+    const int background = 250 - int(window % 8);
+    return qRgb(background, background, background);
+}
+
+QImage ClusterBenchmark::desktopTile(QPoint cell, int tileSize)
+{
+    QImage image(tileSize, tileSize, QImage::Format_RGB32);
+    for (int y = 0; y < tileSize; ++y) {
+        QRgb *scanLine = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < tileSize; ++x) {
+            scanLine[x] = desktopPixel(cell.x()*tileSize + x, cell.y()*tileSize + y);
+        }
+    }
+    return image;
+}
+
+quint32 ClusterBenchmark::mix(quint32 a, quint32 b, quint32 c)
+{
+    quint32 h = a*0x9e3779b1u ^ b*0x85ebca77u ^ c*0xc2b2ae3du;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
@@ -0,0 +1,52 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CLUSTERBENCHMARK_H
+#define CLUSTERBENCHMARK_H
+
+#include <QString>
+#include <QImage>
+#include <QPoint>
+
+#include "tile.h"
+
+//
+// Times the best buddy clustering at the size of large caches. A synthetic
+// desktop with mostly near-white windows and text lines is cut into
+// shuffled tiles, and the fragments found are checked against the known
+// layout.
+//
+class ClusterBenchmark
+{
+public:
+    //
+    // Returns a report for display, or "Cancelled"
+    //
+    static QString run(int numTiles, int tileSize, Tile::Scorer scorer);
+
+private:
+    //
+    // Deterministic desktop pixel at screen position x, y
+    //
+    static QRgb desktopPixel(int x, int y);
+    static QImage desktopTile(QPoint cell, int tileSize);
+    static quint32 mix(quint32 a, quint32 b, quint32 c);
+};
+
+#endif // CLUSTERBENCHMARK_H
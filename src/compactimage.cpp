@@ -0,0 +1,230 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "compactimage.h"
+
+#include <QHash>
+#include <QVector>
+#include <string.h>
+#include <algorithm>
+
+QByteArray CompactImage::encode(const QImage &image)
+{
+    if (image.isNull()) {
+        return QByteArray();
+    }
+    QImage src = image;
+    if (src.format() != QImage::Format_RGB32 && src.format() != QImage::Format_ARGB32) {
+        src = src.convertToFormat(QImage::Format_ARGB32);
+    }
+    const int width = src.width();
+    const int height = src.height();
+    // Collect palette and runs in a single pass
+    QHash<QRgb, int> paletteIndex;
+    QVector<QRgb> palette;
+    bool paletteOverflow = false;
+    int numRuns = 0;
+    QRgb runColor = 0;
+    int runLength = 0;
+    for (int y = 0; y < height; ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const QRgb pixel = line[x];
+            if (!paletteOverflow && !paletteIndex.contains(pixel)) {
+                if (palette.size() == MAX_PALETTE_SIZE) {
+                    paletteOverflow = true;
+                } else {
+                    paletteIndex.insert(pixel, palette.size());
+                    palette.append(pixel);
+                }
+            }
+            if (runLength == 0 || pixel != runColor || runLength == MAX_RUN_LENGTH) {
+                numRuns++;
+                runColor = pixel;
+                runLength = 1;
+            } else {
+                runLength++;
+            }
+        }
+    }
+    Header header;
+    header.format = quint8(src.format());
+    header.width = quint16(width);
+    header.height = quint16(height);
+    header.numColors = 0;
+    header.bits = 0;
+    // Determine cheapest encoding
+    const int rawSize = width*height*4;
+    const int runSize = numRuns*6;
+    int paletteSize = rawSize + 1;
+    if (!paletteOverflow) {
+        if (palette.size() == 1) {
+            header.bits = 0;
+        } else if (palette.size() <= 2) {
+            header.bits = 1;
+        } else if (palette.size() <= 4) {
+            header.bits = 2;
+        } else if (palette.size() <= 16) {
+            header.bits = 4;
+        } else {
+            header.bits = 8;
+        }
+        paletteSize = palette.size()*4 + height*((width*header.bits + 7)/8);
+    }
+    QByteArray result;
+    if (paletteSize <= runSize && paletteSize < rawSize) {
+        header.mode = Palette;
+        header.numColors = quint16(palette.size());
+        const int bytesPerLine = (width*header.bits + 7)/8;
+        result.resize(int(sizeof(Header)) + paletteSize);
+        result.fill(0);
+        char *out = result.data();
+        memcpy(out, &header, sizeof(Header));
+        out += sizeof(Header);
+        memcpy(out, palette.constData(), palette.size()*4);
+        out += palette.size()*4;
+        if (header.bits > 0) {
+            uchar *indices = reinterpret_cast<uchar *>(out);
+            for (int y = 0; y < height; ++y) {
+                const QRgb *line = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+                uchar *outLine = indices + y*bytesPerLine;
+                for (int x = 0; x < width; ++x) {
+                    const int bitPos = x*header.bits;
+                    const int shift = 8 - header.bits - (bitPos & 7);
+                    outLine[bitPos >> 3] |= uchar(paletteIndex.value(line[x]) << shift);
+                }
+            }
+        }
+    } else if (runSize < rawSize) {
+        header.mode = RunLength;
+        result.resize(int(sizeof(Header)) + runSize);
+        char *out = result.data();
+        memcpy(out, &header, sizeof(Header));
+        out += sizeof(Header);
+        runLength = 0;
+        for (int y = 0; y < height; ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+            for (int x = 0; x < width; ++x) {
+                const QRgb pixel = line[x];
+                if (runLength == 0 || pixel != runColor || runLength == MAX_RUN_LENGTH) {
+                    if (runLength > 0) {
+                        const quint16 length = quint16(runLength);
+                        memcpy(out, &length, 2);
+                        memcpy(out + 2, &runColor, 4);
+                        out += 6;
+                    }
+                    runColor = pixel;
+                    runLength = 1;
+                } else {
+                    runLength++;
+                }
+            }
+        }
+        const quint16 length = quint16(runLength);
+        memcpy(out, &length, 2);
+        memcpy(out + 2, &runColor, 4);
+    } else {
+        header.mode = Raw;
+        result.resize(int(sizeof(Header)) + rawSize);
+        char *out = result.data();
+        memcpy(out, &header, sizeof(Header));
+        out += sizeof(Header);
+        for (int y = 0; y < height; ++y) {
+            memcpy(out + y*width*4, src.constScanLine(y), width*4);
+        }
+    }
+    return result;
+}
+
+QImage CompactImage::decode(const QByteArray &data)
+{
+    if (data.size() < int(sizeof(Header))) {
+        return QImage();
+    }
+    Header header;
+    memcpy(&header, data.constData(), sizeof(Header));
+    const char *in = data.constData() + sizeof(Header);
+    const int width = header.width;
+    const int height = header.height;
+    QImage image(width, height, QImage::Format(header.format));
+    switch (header.mode) {
+    case Palette:
+    {
+        QVector<QRgb> palette(header.numColors);
+        memcpy(palette.data(), in, header.numColors*4);
+        const uchar *indices = reinterpret_cast<const uchar *>(in + header.numColors*4);
+        const int bytesPerLine = (width*header.bits + 7)/8;
+        const int mask = (1 << header.bits) - 1;
+        for (int y = 0; y < height; ++y) {
+            QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+            if (header.bits == 0) {
+                std::fill(line, line + width, palette.at(0));
+                continue;
+            }
+            const uchar *inLine = indices + y*bytesPerLine;
+            for (int x = 0; x < width; ++x) {
+                const int bitPos = x*header.bits;
+                const int shift = 8 - header.bits - (bitPos & 7);
+                line[x] = palette.at((inLine[bitPos >> 3] >> shift) & mask);
+            }
+        }
+    }
+        break;
+    case RunLength:
+    {
+        int x = 0;
+        int y = 0;
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(0));
+        while (y < height) {
+            quint16 length;
+            QRgb color;
+            memcpy(&length, in, 2);
+            memcpy(&color, in + 2, 4);
+            in += 6;
+            for (int i = 0; i < length; ++i) {
+                line[x++] = color;
+                if (x == width) {
+                    x = 0;
+                    if (++y == height) {
+                        break;
+                    }
+                    line = reinterpret_cast<QRgb *>(image.scanLine(y));
+                }
+            }
+        }
+    }
+        break;
+    default:
+        for (int y = 0; y < height; ++y) {
+            memcpy(image.scanLine(y), in + y*width*4, width*4);
+        }
+        break;
+    }
+    return image;
+}
+
+CompactImage::Mode CompactImage::mode(const QByteArray &data)
+{
+    if (data.size() < int(sizeof(Header))) {
+        return Raw;
+    }
+    Header header;
+    memcpy(&header, data.constData(), sizeof(Header));
+    return Mode(header.mode);
+}
@@ -0,0 +1,57 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPACTIMAGE_H
+#define COMPACTIMAGE_H
+
+#include <QByteArray>
+#include <QImage>
+
+//
+// In-memory encoding for tile pixels. RDP cache tiles are often solid or use
+// only a few colors, so each tile is stored either palette-indexed, run-length
+// encoded or raw, whichever is smallest.
+//
+class CompactImage
+{
+public:
+    enum Mode {Raw, Palette, RunLength};
+
+    static QByteArray encode(const QImage &image);
+    static QImage decode(const QByteArray &data);
+    static Mode mode(const QByteArray &data);
+
+private:
+    static const int MAX_PALETTE_SIZE = 256;
+    static const int MAX_RUN_LENGTH = 65535;
+
+    struct Header {
+        quint8 mode;
+        quint8 format;
+        quint16 width;
+        quint16 height;
+        //
+        // Palette: number of colors and bits per index
+        //
+        quint16 numColors;
+        quint8 bits;
+    };
+};
+
+#endif // COMPACTIMAGE_H
@@ -0,0 +1,108 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "edgebenchmark.h"
+
+#include <QElapsedTimer>
+
+QString EdgeBenchmark::run(const QImage &image, int tileSize)
+{
+    const Result euclidean = evaluate(image, tileSize, Tile::Euclidean, Tile::ColorsGauss15);
+    const Result sad = evaluate(image, tileSize, Tile::Sad, Tile::ColorsGauss15);
+    const Result gradients = evaluate(image, tileSize, Tile::Sad, Tile::Gradients);
+    int numAgreeing = 0;
+    for (int i = 0; i < euclidean.best.size(); ++i) {
+        if (euclidean.best.at(i) == sad.best.at(i)) {
+            numAgreeing++;
+        }
+    }
+    const int numTiles = (image.width()/tileSize)*(image.height()/tileSize);
+    return QString("Edge metrics on ") + QString::number(numTiles) + " tiles, "
+            + QString::number(euclidean.numQueries) + " neighbour queries\n\n"
+            + format("Boundary colors, Gauss 15, Euclidean (floating point)", euclidean) + "\n\n"
+            + format("Boundary colors, Gauss 15, SAD (8 bit)", sad) + "\n\n"
+            + format("Gradient prediction (MGC)", gradients) + "\n\n"
+            + "Same best candidate for Euclidean and SAD: "
+            + QString::number(euclidean.numQueries > 0 ? 100.0*numAgreeing/euclidean.numQueries : 0.0, 'f', 1) + "%";
+}
+
+EdgeBenchmark::Result EdgeBenchmark::evaluate(const QImage &image, int tileSize, Tile::EdgeMetric metric, Tile::Scorer scorer)
+{
+    Result result;
+    const int numRows = image.height()/tileSize;
+    const int numCols = image.width()/tileSize;
+    QVector<Tile> tiles;
+    for (int row = 0; row < numRows; ++row) {
+        for (int col = 0; col < numCols; ++col) {
+            Tile t(image.copy(col*tileSize, row*tileSize, tileSize, tileSize), false, false, metric);
+            t.dropImage();
+            result.featureBytes += t.featureBytes();
+            tiles.append(t);
+        }
+    }
+    QElapsedTimer timer;
+    timer.start();
+    for (int row = 0; row < numRows; ++row) {
+        for (int col = 0; col < numCols; ++col) {
+            Tile &tile = tiles[row*numCols + col];
+            for (Tile::Edge edge : {Tile::Edge::Right, Tile::Edge::Bottom}) {
+                if ((edge == Tile::Edge::Right && col + 1 == numCols) || (edge == Tile::Edge::Bottom && row + 1 == numRows)) {
+                    continue;
+                }
+                const int truth = (edge == Tile::Edge::Right) ? row*numCols + col + 1 : (row + 1)*numCols + col;
+                const double trueScore = tile.calcEdgeScore(tiles[truth], scorer, edge);
+                // Ties with the true neighbour do not count against it
+                int rank = 1;
+                int best = -1;
+                double bestScore = -1.0;
+                for (int i = 0; i < tiles.size(); ++i) {
+                    if (i == row*numCols + col) {
+                        continue;
+                    }
+                    const double score = tile.calcEdgeScore(tiles[i], scorer, edge);
+                    if (score > trueScore) {
+                        rank++;
+                    }
+                    if (score > bestScore) {
+                        bestScore = score;
+                        best = i;
+                    }
+                }
+                result.numQueries++;
+                if (rank == 1) {
+                    result.numTop1++;
+                }
+                result.reciprocalRankSum += 1.0/rank;
+                result.best.append(best);
+            }
+        }
+    }
+    result.scoreTimeNs = timer.nsecsElapsed();
+    return result;
+}
+
+QString EdgeBenchmark::format(const QString &name, const EdgeBenchmark::Result &result)
+{
+    const int numQueries = qMax(result.numQueries, 1);
+    return name + ":\n"
+            + "True neighbour ranked first: " + QString::number(100.0*result.numTop1/numQueries, 'f', 1) + "%\n"
+            + "Mean reciprocal rank: " + QString::number(result.reciprocalRankSum/numQueries, 'f', 3) + "\n"
+            + "Edge features: " + QString::number(result.featureBytes/1024) + " KB\n"
+            + "Scoring time: " + QString::number(result.scoreTimeNs/1000000.0, 'f', 1) + " ms";
+}
@@ -0,0 +1,59 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef EDGEBENCHMARK_H
+#define EDGEBENCHMARK_H
+
+#include <QString>
+#include <QImage>
+#include <QVector>
+
+#include "tile.h"
+
+//
+// Compares edge metrics and scorers on an image with known tile layout: the
+// image is cut into tiles and, for each pair of adjacent tiles, the true
+// neighbour is ranked among all tiles by edge score.
+//
+class EdgeBenchmark
+{
+public:
+    //
+    // Returns a report for display
+    //
+    static QString run(const QImage &image, int tileSize);
+
+private:
+    struct Result {
+        int numQueries = 0;
+        int numTop1 = 0;
+        double reciprocalRankSum = 0.0;
+        qint64 featureBytes = 0;
+        qint64 scoreTimeNs = 0;
+        //
+        // Best scoring candidate per query
+        //
+        QVector<int> best;
+    };
+
+    static Result evaluate(const QImage &image, int tileSize, Tile::EdgeMetric metric, Tile::Scorer scorer);
+    static QString format(const QString &name, const Result &result);
+};
+
+#endif // EDGEBENCHMARK_H
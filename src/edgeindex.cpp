@@ -0,0 +1,111 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "edgeindex.h"
+
+const int EdgeIndex::QUANTIZATION_SHIFT = 4;
+
+void EdgeIndex::clear()
+{
+    for (int edge = 0; edge < 4; ++edge) {
+        for (int precision = 0; precision < NUM_PRECISIONS; ++precision) {
+            buckets[edge][precision].clear();
+        }
+    }
+}
+
+void EdgeIndex::rebuild(const QList<Tile> &tiles)
+{
+    clear();
+    for (int i = 0; i < tiles.size(); ++i) {
+        if (!tiles.at(i).isRemoved) {
+            append(i, tiles.at(i));
+        }
+    }
+}
+
+void EdgeIndex::append(int index, const Tile &tile)
+{
+    for (int edge = 0; edge < 4; ++edge) {
+        for (int precision = 0; precision < NUM_PRECISIONS; ++precision) {
+            const int shift = shiftOf(Precision(precision));
+            if (tile.isUniformBoundary(Tile::Edge(edge), shift)) {
+                continue;
+            }
+            const quint32 hash = tile.boundaryHash(Tile::Edge(edge), shift);
+            buckets[edge][precision][hash].append(index);
+        }
+    }
+}
+
+void EdgeIndex::remove(int index, const Tile &tile)
+{
+    for (int edge = 0; edge < 4; ++edge) {
+        for (int precision = 0; precision < NUM_PRECISIONS; ++precision) {
+            const int shift = shiftOf(Precision(precision));
+            if (tile.isUniformBoundary(Tile::Edge(edge), shift)) {
+                continue;
+            }
+            const quint32 hash = tile.boundaryHash(Tile::Edge(edge), shift);
+            auto it = buckets[edge][precision].find(hash);
+            if (it == buckets[edge][precision].end()) {
+                continue;
+            }
+            it->removeOne(index);
+            if (it->isEmpty()) {
+                buckets[edge][precision].erase(it);
+            }
+        }
+    }
+}
+
+QVector<int> EdgeIndex::continuations(const Tile &tile, Tile::Edge edge, EdgeIndex::Precision precision, const QList<Tile> &tiles) const
+{
+    const int shift = shiftOf(precision);
+    if (tile.isUniformBoundary(edge, shift)) {
+        return QVector<int>();
+    }
+    const Tile::Edge otherEdge = tile.oppositeEdge(edge);
+    const QVector<int> bucket = buckets[otherEdge][precision].value(tile.boundaryHash(edge, shift));
+    QVector<int> result;
+    result.reserve(bucket.size());
+    foreach (int index, bucket) {
+        if (tile.continuesInto(tiles.at(index), edge, shift)) {
+            result.append(index);
+        }
+    }
+    return result;
+}
+
+QString EdgeIndex::report() const
+{
+    int numBuckets[NUM_PRECISIONS] = {0, 0};
+    for (int edge = 0; edge < 4; ++edge) {
+        for (int precision = 0; precision < NUM_PRECISIONS; ++precision) {
+            numBuckets[precision] += buckets[edge][precision].size();
+        }
+    }
+    return QString("Edge index: ") + QString::number(numBuckets[Exact]) + " exact and "
+            + QString::number(numBuckets[Quantized]) + " quantized boundary hashes";
+}
+
+int EdgeIndex::shiftOf(EdgeIndex::Precision precision)
+{
+    return (precision == Exact) ? 0 : QUANTIZATION_SHIFT;
+}
@@ -0,0 +1,66 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef EDGEINDEX_H
+#define EDGEINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "tile.h"
+
+//
+// Hash indexes over the outermost pixel line of every tile edge, exact and
+// quantized. Finds the tiles that continue a given edge without scoring
+// the whole store. Single-colored lines are left out: blank edges of a
+// cache fall into one huge bucket, and continuing them says nothing, so
+// such edges are only scored.
+//
+class EdgeIndex
+{
+public:
+    enum Precision {Exact, Quantized, NUM_PRECISIONS};
+    //
+    // Low bits dropped from each channel for the quantized index
+    //
+    static const int QUANTIZATION_SHIFT;
+
+    void clear();
+    void rebuild(const QList<Tile> &tiles);
+    void append(int index, const Tile &tile);
+    void remove(int index, const Tile &tile);
+    //
+    // Tiles whose opposite edge continues the given edge of tile, verified
+    // against hash collisions; empty for single-colored edges
+    //
+    QVector<int> continuations(const Tile &tile, Tile::Edge edge, Precision precision, const QList<Tile> &tiles) const;
+    QString report() const;
+
+private:
+    //
+    // Tile indices by boundary hash, per edge and precision
+    //
+    QHash<quint32, QVector<int>> buckets[4][NUM_PRECISIONS];
+
+    static int shiftOf(Precision precision);
+};
+
+#endif // EDGEINDEX_H
@@ -0,0 +1,56 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "locatedialog.h"
+#include "ui_locatedialog.h"
+
+#include <QTableWidgetItem>
+
+LocateDialog::LocateDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::LocateDialog)
+{
+    ui->setupUi(this);
+}
+
+LocateDialog::~LocateDialog()
+{
+    delete ui;
+}
+
+void LocateDialog::setPlacements(const QVector<ScreenLabel::Placement> &placements)
+{
+    ui->placementsTable->setRowCount(placements.size());
+    for (int i = 0; i < placements.size(); ++i) {
+        const ScreenLabel::Placement &placement = placements.at(i);
+        // Screens are numbered from 1 like in the screen spin box
+        ui->placementsTable->setItem(i, 0, new QTableWidgetItem(QString::number(placement.screen + 1)));
+        ui->placementsTable->setItem(i, 1, new QTableWidgetItem(QString::number(placement.cell.x())));
+        ui->placementsTable->setItem(i, 2, new QTableWidgetItem(QString::number(placement.cell.y())));
+        ui->placementsTable->setItem(i, 3, new QTableWidgetItem(QString::number(placement.score, 'f', 3)));
+    }
+    if (!placements.isEmpty()) {
+        ui->placementsTable->selectRow(0);
+    }
+}
+
+int LocateDialog::selectedPlacement()
+{
+    return ui->placementsTable->currentRow();
+}
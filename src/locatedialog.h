@@ -0,0 +1,53 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOCATEDIALOG_H
+#define LOCATEDIALOG_H
+
+#include <QDialog>
+
+#include "screenlabel.h"
+
+namespace Ui {
+class LocateDialog;
+}
+
+//
+// Ranked placements of a tile on all screens; the selected one is shown
+// when the dialog is accepted
+//
+class LocateDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit LocateDialog(QWidget *parent = 0);
+    ~LocateDialog();
+
+    void setPlacements(const QVector<ScreenLabel::Placement> &placements);
+    //
+    // Return the selected placement's index, or -1 if none is selected
+    //
+    int selectedPlacement();
+
+private:
+    Ui::LocateDialog *ui;
+};
+
+#endif // LOCATEDIALOG_H
@@ -44,6 +44,7 @@
 #include "screenlabel.h"
 #include "recommendationslabel.h"
 #include "tilestorewidget.h"
+#include "updatescheduler.h"
 
 int main(int argc, char *argv[])
 {
@@ -56,6 +57,10 @@ int main(int argc, char *argv[])
     QImage startImage(":/images/data/RCS_start_screen.jpg");
     TileStore store(startImage, 64);
     w.registerTileStore(&store);
+    UpdateScheduler scheduler;
+    TileIngestor ingestor(&store);
+    w.registerTileIngestor(&ingestor);
+    QObject::connect(&ingestor, SIGNAL(statusChanged(QString)), w.statusBar(), SLOT(showMessage(QString)));
     TileStoreWidget *tileStoreWidget = new TileStoreWidget(&store);
     QDockWidget storeDock("Tile store", &w);
     storeDock.setStyleSheet("::title { text-align: center }");
@@ -86,18 +91,12 @@ int main(int argc, char *argv[])
 
     // Best match area
     RecommendationsLabel *recommendationsLabel = new RecommendationsLabel(&store, screenLabel->getRecommendations());
-    QScrollArea *recommendationsArea = new QScrollArea();
-    recommendationsArea->setBackgroundRole(QPalette::Light);
-    recommendationsArea->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
-    recommendationsArea->setWidget(recommendationsLabel);
-    recommendationsArea->setMinimumWidth(recommendationsLabel->getCellSize() + recommendationsArea->verticalScrollBar()->width());
-    recommendationsArea->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
     // Combine Screen and Best Match
     QWidget *upperWidget = w.findChild<QWidget *>("workAreaWidget");
     QHBoxLayout *upperLayout = new QHBoxLayout();
     upperLayout->addWidget(screenArea);
-    upperLayout->addWidget(recommendationsArea);
+    upperLayout->addWidget(recommendationsLabel);
     upperLayout->setStretch(0, 1);
     upperLayout->setStretch(1, 0);
     upperWidget->setLayout(upperLayout);
@@ -110,9 +109,17 @@ int main(int argc, char *argv[])
     QObject::connect(&w, SIGNAL(tileStoreChanged()), screenLabel, SLOT(tileStoreChanged()));
     QObject::connect(&w, SIGNAL(tileStoreChanged()), tileStoreWidget, SLOT(tileStoreChanged()));
     QObject::connect(&w, SIGNAL(tileStoreChanged()), recommendationsLabel, SLOT(tileStoreChanged()));
-    QObject::connect(&store, SIGNAL(availableTilesChanged()), tileStoreWidget, SLOT(tileStoreChanged()));
-    QObject::connect(&store, SIGNAL(availableTilesChanged()), screenLabel, SLOT(updateRecommendations()));
-    QObject::connect(screenLabel, SIGNAL(availableTilesChanged()), tileStoreWidget, SLOT(tileStoreChanged()));
+    // Store and screen changes are applied once per event loop turn
+    QObject::connect(&store, SIGNAL(availableTilesChanged()), &scheduler, SLOT(allTilesChanged()));
+    QObject::connect(&store, SIGNAL(tilesInserted(int,int)), &scheduler, SLOT(tilesInserted(int,int)));
+    QObject::connect(&store, SIGNAL(tilesRemoved(QVector<int>)), &scheduler, SLOT(tilesRemoved(QVector<int>)));
+    QObject::connect(&store, SIGNAL(useCountsChanged(QVector<int>)), &scheduler, SLOT(useCountsChanged(QVector<int>)));
+    QObject::connect(&store, SIGNAL(visibilityChanged(int)), &scheduler, SLOT(visibilityChanged(int)));
+    QObject::connect(screenLabel, SIGNAL(cellChanged(QPoint)), &scheduler, SLOT(cellChanged(QPoint)));
+    QObject::connect(&scheduler, SIGNAL(changesReady(TileChanges)), tileStoreWidget, SLOT(applyChanges(TileChanges)));
+    QObject::connect(&scheduler, SIGNAL(changesReady(TileChanges)), screenLabel, SLOT(applyChanges(TileChanges)));
+    QObject::connect(&scheduler, SIGNAL(changesReady(TileChanges)), screenLabel->getBestFitMap(), SLOT(applyChanges(TileChanges)));
+    QObject::connect(screenLabel->getBestFitMap(), SIGNAL(fitsChanged(QVector<QPoint>)), screenLabel, SLOT(bestFitsChanged(QVector<QPoint>)));
 
     NotesDialog *notesDialog = screenLabel->getNotesDialog();
     Q_ASSERT(notesDialog != NULL);
@@ -124,6 +131,12 @@ int main(int argc, char *argv[])
     Q_ASSERT(screenNumberSpinBox != NULL);
     QObject::connect(screenNumberSpinBox, SIGNAL(valueChanged(int)), screenLabel, SLOT(screenNumberChanged(int)));
 
+    QComboBox *zoomComboBox = w.findChild<QComboBox *>("zoomComboBox");
+    Q_ASSERT(zoomComboBox != NULL);
+    QObject::connect(zoomComboBox, SIGNAL(currentIndexChanged(int)), screenLabel, SLOT(setZoomLevel(int)));
+    QObject::connect(screenLabel, SIGNAL(zoomLevelChanged(int)), zoomComboBox, SLOT(setCurrentIndex(int)));
+    QObject::connect(&store, SIGNAL(mipmapsReady()), screenLabel, SLOT(mipmapsReady()));
+
     QCheckBox *screenNotesCB = w.findChild<QCheckBox *>("screenNotesCheckBox");
     Q_ASSERT(screenNotesCB != NULL);
     QObject::connect(screenNotesCB, SIGNAL(stateChanged(int)), screenLabel, SLOT(notesWindowStateChanges(int)));
@@ -141,6 +154,10 @@ int main(int argc, char *argv[])
     Q_ASSERT(hideNonSquareCB != NULL);
     QObject::connect(hideNonSquareCB, SIGNAL(stateChanged(int)), &store, SLOT(hideNonSquareChanged(int)));
 
+    QCheckBox *hideSolidCB = w.findChild<QCheckBox *>("hideSolidCheckBox");
+    Q_ASSERT(hideSolidCB != NULL);
+    QObject::connect(hideSolidCB, SIGNAL(stateChanged(int)), &store, SLOT(hideSolidChanged(int)));
+
     QSpinBox *storeWidthSpinBox = w.findChild<QSpinBox *>("storeWidthSpinBox");
     Q_ASSERT(storeWidthSpinBox != NULL);
     QObject::connect(storeWidthSpinBox, SIGNAL(valueChanged(int)), tileStoreWidget, SLOT(tileStoreWidthChanged(int)));
@@ -20,10 +20,17 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "aboutdialog.h"
+#include "screenexporter.h"
+#include "edgebenchmark.h"
+#include "scorerdialog.h"
+#include "locatedialog.h"
+#include "buddyclusterer.h"
+#include "clusterbenchmark.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QProgressDialog>
+#include <QInputDialog>
 
 const QString MainWindow::PROGRAM_VERSION("1.1");
 
@@ -50,11 +57,32 @@ void MainWindow::displayMessage(const QString &message) {
     msgBox.exec();
 }
 
+bool MainWindow::runWithProgress(const QString &label, QFutureWatcherBase &watcher)
+{
+    QProgressDialog pd(label, "Cancel", watcher.progressMinimum(), watcher.progressMaximum(), QApplication::activeWindow());
+    pd.setWindowModality(Qt::WindowModal);
+    pd.setMinimumDuration(0);
+    QObject::connect(&watcher, SIGNAL(progressRangeChanged(int,int)), &pd, SLOT(setRange(int,int)));
+    QObject::connect(&watcher, SIGNAL(progressValueChanged(int)), &pd, SLOT(setValue(int)));
+    QObject::connect(&watcher, SIGNAL(finished()), &pd, SLOT(reset()));
+    QObject::connect(&pd, SIGNAL(canceled()), &watcher, SLOT(cancel()));
+    if (!watcher.isFinished()) {
+        pd.exec();
+    }
+    watcher.waitForFinished();
+    return !watcher.isCanceled();
+}
+
 void MainWindow::registerTileStore(TileStore *tileStore)
 {
     this->tileStore = tileStore;
 }
 
+void MainWindow::registerTileIngestor(TileIngestor *tileIngestor)
+{
+    this->tileIngestor = tileIngestor;
+}
+
 void MainWindow::registerScreenLabel(ScreenLabel *screenLabel)
 {
     this->screenLabel = screenLabel;
@@ -70,22 +98,137 @@ void MainWindow::on_actionNew_case_triggered()
         dialog.setOption(QFileDialog::ShowDirsOnly, false);
         dialog.setViewMode(QFileDialog::Detail);
         if (dialog.exec() == QDialog::Accepted) {
-            QString dir = dialog.directory().absolutePath();
-            Q_ASSERT(tileStore != NULL);
-            setUpdatesEnabled(false);
-            QString result = tileStore->loadTiles(dir);
-            if (!result.isEmpty()) {
-                displayMessage("Error while loading tiles:\n" + result);
-            }
-            emit tileStoreChanged();
-            screenLabel->initScreens();
-            ui->screenNumberSpinBox->setValue(1);
-            setUpdatesEnabled(true);
-            setWindowTitle("Unnamed case");
+            newCase(dialog.directory().absolutePath());
         }
     }
 }
 
+void MainWindow::newCase(QString dir)
+{
+    Q_ASSERT(tileStore != NULL);
+    stopWatching();
+    setUpdatesEnabled(false);
+    if (dir.isEmpty()) {
+        tileStore->clear();
+    } else {
+        QString result = tileStore->loadTiles(dir);
+        if (!result.isEmpty()) {
+            displayMessage("Error while loading tiles:\n" + result);
+        }
+    }
+    emit tileStoreChanged();
+    screenLabel->initScreens();
+    ui->screenNumberSpinBox->setValue(1);
+    setUpdatesEnabled(true);
+    setWindowTitle("Unnamed case");
+}
+
+void MainWindow::on_actionAdd_cache_directory_triggered()
+{
+    QFileDialog dialog(this);
+    dialog.setWindowTitle("Add cache: Please select a directory with .bmp RDP cache images");
+    dialog.setAcceptMode(QFileDialog::AcceptOpen);
+    dialog.setFileMode(QFileDialog::DirectoryOnly);
+    dialog.setOption(QFileDialog::ShowDirsOnly, false);
+    dialog.setViewMode(QFileDialog::Detail);
+    if (dialog.exec() == QDialog::Accepted) {
+        QString dir = dialog.directory().absolutePath();
+        Q_ASSERT(tileStore != NULL);
+        Q_ASSERT(screenLabel != NULL);
+        if (tileStore->numSources() == 0) {
+            // Nothing loaded yet besides the start screen
+            newCase(dir);
+            return;
+        }
+        // Screens stay as they are, the new tiles are appended
+        Q_ASSERT(tileIngestor != NULL);
+        tileIngestor->suspend();
+        QString result = tileStore->appendTiles(dir);
+        tileIngestor->resume();
+        if (!result.isEmpty()) {
+            displayMessage("Error while loading tiles:\n" + result);
+            return;
+        }
+        screenLabel->setModified();
+    }
+}
+
+void MainWindow::on_actionWatch_cache_directory_toggled(bool checked)
+{
+    Q_ASSERT(tileIngestor != NULL);
+    if (!checked) {
+        tileIngestor->stop();
+        return;
+    }
+    QFileDialog dialog(this);
+    dialog.setWindowTitle("Watch cache: Please select the directory RDP cache images are extracted to");
+    dialog.setAcceptMode(QFileDialog::AcceptOpen);
+    dialog.setFileMode(QFileDialog::DirectoryOnly);
+    dialog.setOption(QFileDialog::ShowDirsOnly, false);
+    dialog.setViewMode(QFileDialog::Detail);
+    if (dialog.exec() != QDialog::Accepted) {
+        ui->actionWatch_cache_directory->blockSignals(true);
+        ui->actionWatch_cache_directory->setChecked(false);
+        ui->actionWatch_cache_directory->blockSignals(false);
+        return;
+    }
+    if (tileStore->numSources() == 0) {
+        // Nothing loaded yet besides the start screen: start with an empty case
+        newCase(QString());
+    }
+    // Tiles already in the directory are ingested as well
+    tileIngestor->start(dialog.directory().absolutePath());
+    screenLabel->setModified();
+}
+
+void MainWindow::on_actionRemove_cache_directory_triggered()
+{
+    Q_ASSERT(tileStore != NULL);
+    Q_ASSERT(screenLabel != NULL);
+    if (tileStore->numSources() == 0) {
+        displayMessage("No cache directory has been loaded.");
+        return;
+    }
+    QStringList names;
+    for (int source = 0; source < tileStore->numSources(); ++source) {
+        names.append(tileStore->sourceName(source));
+    }
+    bool ok;
+    const QString name = QInputDialog::getItem(
+                this,
+                "Remove cache directory",
+                "Tiles to remove from the case:",
+                names, names.size() - 1, false, &ok);
+    if (!ok) {
+        return;
+    }
+    // Indices of the remaining tiles do not change, so screens stay as they are
+    const QVector<int> tiles = tileStore->sourceTiles(names.indexOf(name));
+    int numActive = 0;
+    for (int i = 0; i < tiles.size(); ++i) {
+        if (!tileStore->isRemoved(tiles.at(i))) {
+            numActive++;
+        }
+    }
+    const int numRemoved = tileStore->removeTiles(tiles);
+    if (numRemoved > 0) {
+        screenLabel->setModified();
+    }
+    displayMessage(QString("Removed ") + QString::number(numRemoved) + " tiles."
+                   + (numRemoved < numActive ? "\n" + QString::number(numActive - numRemoved)
+                                               + " tiles are kept because they are placed on screens." : ""));
+}
+
+void MainWindow::stopWatching()
+{
+    if (tileIngestor != NULL && tileIngestor->isActive()) {
+        tileIngestor->stop();
+        ui->actionWatch_cache_directory->blockSignals(true);
+        ui->actionWatch_cache_directory->setChecked(false);
+        ui->actionWatch_cache_directory->blockSignals(false);
+    }
+}
+
 void MainWindow::on_actionSave_case_as_triggered()
 {
     QFileDialog dialog(this);
@@ -105,7 +248,11 @@ void MainWindow::on_actionSave_case_as_triggered()
             tileStore->name = filename;
             Q_ASSERT(screenLabel != NULL);
             screenLabel->storeCurrentScreen();
+            // Tile count and per-tile data must match in the file
+            Q_ASSERT(tileIngestor != NULL);
+            tileIngestor->suspend();
             QString result = screenLabel->saveCase(filename);
+            tileIngestor->resume();
             setWindowTitle(filename);
             if (!result.isEmpty()) {
                 displayMessage("Error while saving case:\n" + result);
@@ -121,7 +268,10 @@ void MainWindow::on_actionSave_case_triggered()
     } else {
         Q_ASSERT(screenLabel != NULL);
         screenLabel->storeCurrentScreen();
+        Q_ASSERT(tileIngestor != NULL);
+        tileIngestor->suspend();
         QString result = screenLabel->saveCase(tileStore->name);
+        tileIngestor->resume();
         if (!result.isEmpty()) {
             displayMessage("Error while saving case:\n" + result);
         }
@@ -146,6 +296,7 @@ void MainWindow::on_actionOpen_case_triggered()
                 caseDialogPath = dialog.directory().absolutePath();
                 tileStore->name = filename;
                 Q_ASSERT(screenLabel != NULL);
+                stopWatching();
                 setUpdatesEnabled(false);
                 QString result = screenLabel->loadCase(filename);
                 if (!result.isEmpty()) {
@@ -167,6 +318,13 @@ void MainWindow::on_actionExport_screen_images_triggered()
     dialog.setAcceptMode(QFileDialog::AcceptSave);
     dialog.setFileMode(QFileDialog::AnyFile);
     dialog.setViewMode(QFileDialog::Detail);
+    const QStringList formats = QStringList() << "png" << "bmp" << "dzi";
+    const QStringList nameFilters = QStringList()
+            << "PNG images (*.png)"
+            << "BMP images (*.bmp)"
+            << "Deep Zoom image pyramids (*.dzi)";
+    dialog.setNameFilters(nameFilters);
+    dialog.selectNameFilter(nameFilters.at(std::max(0, formats.indexOf(ScreenExporter::g_format))));
     QString suggestion = tileStore->name;
     while(suggestion.endsWith(".rcs")) {
         suggestion.truncate(suggestion.length() - 4);
@@ -175,8 +333,9 @@ void MainWindow::on_actionExport_screen_images_triggered()
     if (dialog.exec()) {
         QStringList fileNames = dialog.selectedFiles();
         if (!fileNames.isEmpty()) {
+            ScreenExporter::g_format = formats.at(std::max(0, nameFilters.indexOf(dialog.selectedNameFilter())));
             QString prefix = fileNames[0];
-            while(prefix.endsWith(".png")) {
+            while(prefix.endsWith(".png") || prefix.endsWith(".bmp") || prefix.endsWith(".dzi")) {
                 prefix.truncate(prefix.length() - 4);
             }
             QString result = screenLabel->exportScreens(prefix);
@@ -221,3 +380,165 @@ void MainWindow::on_actionAbout_triggered() {
     about.setWindowTitle("About RdpCacheStitcher " + PROGRAM_VERSION);
     about.exec();
 }
+
+void MainWindow::on_actionStatistics_triggered()
+{
+    Q_ASSERT(tileStore != NULL);
+    Q_ASSERT(screenLabel != NULL);
+    QMessageBox::information(this, "Statistics", tileStore->memoryReport() + "\n\n" + screenLabel->paintReport());
+}
+
+void MainWindow::on_actionTile_memory_limit_triggered()
+{
+    Q_ASSERT(tileStore != NULL);
+    bool ok;
+    int limit = QInputDialog::getInt(
+                this,
+                "Tile memory limit",
+                "Maximum memory for paged-in tile pixels (MB):",
+                tileStore->getPixelMemoryLimit(),
+                16, 1024*1024, 64, &ok);
+    if (ok) {
+        tileStore->setPixelMemoryLimit(limit);
+    }
+}
+
+void MainWindow::on_actionCompact_tile_encoding_toggled(bool checked)
+{
+    Q_ASSERT(tileStore != NULL);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    tileStore->setCompactPixels(checked);
+    QApplication::restoreOverrideCursor();
+}
+
+void MainWindow::on_actionFast_edge_matching_toggled(bool checked)
+{
+    Q_ASSERT(tileStore != NULL);
+    Q_ASSERT(screenLabel != NULL);
+    Q_ASSERT(tileIngestor != NULL);
+    // Edge profiles are recomputed on a copy of the store
+    tileIngestor->suspend();
+    const bool success = tileStore->setEdgeMetric(checked ? Tile::Sad : Tile::Euclidean);
+    tileIngestor->resume();
+    if (!success) {
+        // Cancelled: the previous metric is still in use
+        ui->actionFast_edge_matching->blockSignals(true);
+        ui->actionFast_edge_matching->setChecked(!checked);
+        ui->actionFast_edge_matching->blockSignals(false);
+        return;
+    }
+    screenLabel->getBestFitMap()->invalidateAll();
+    screenLabel->updateMatchValues();
+}
+
+void MainWindow::on_actionEdge_metric_benchmark_triggered()
+{
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const QString report = EdgeBenchmark::run(QImage(":/images/data/RCS_start_screen.jpg"), 64);
+    QApplication::restoreOverrideCursor();
+    QMessageBox::information(this, "Edge metric benchmark", report);
+}
+
+void MainWindow::on_actionClustering_benchmark_triggered()
+{
+    const QString report = ClusterBenchmark::run(100000, 64, ScreenLabel::g_scorers[ScreenLabel::Autoplace]);
+    if (report == "Cancelled") {
+        return;
+    }
+    QMessageBox::information(this, "Clustering benchmark", report);
+}
+
+void MainWindow::on_actionEdge_scorers_triggered()
+{
+    Q_ASSERT(screenLabel != NULL);
+    ScorerDialog dialog(this);
+    for (int operation = 0; operation < ScreenLabel::NUM_OPERATIONS; ++operation) {
+        dialog.setScorer(ScreenLabel::Operation(operation), ScreenLabel::g_scorers[operation]);
+    }
+    if (dialog.exec() == QDialog::Accepted) {
+        for (int operation = 0; operation < ScreenLabel::NUM_OPERATIONS; ++operation) {
+            ScreenLabel::g_scorers[operation] = dialog.getScorer(ScreenLabel::Operation(operation));
+        }
+        screenLabel->getBestFitMap()->invalidateAll();
+        screenLabel->updateMatchValues();
+    }
+}
+
+void MainWindow::on_actionBest_fit_overlay_toggled(bool checked)
+{
+    Q_ASSERT(screenLabel != NULL);
+    screenLabel->setBestFitOverlay(checked);
+}
+
+void MainWindow::on_actionLocate_tile_triggered()
+{
+    Q_ASSERT(screenLabel != NULL);
+    const int tileIndex = screenLabel->selectedStoreIndex();
+    if (tileIndex == -1) {
+        displayMessage("Please select a tile in the tile store first.");
+        return;
+    }
+    QVector<ScreenLabel::Placement> placements;
+    const QString result = screenLabel->locate(tileIndex, &placements);
+    if (!result.isEmpty()) {
+        return;
+    }
+    if (placements.isEmpty()) {
+        displayMessage("No place on any screen matches the selected tile.");
+        return;
+    }
+    LocateDialog dialog(this);
+    dialog.setPlacements(placements);
+    if (dialog.exec() != QDialog::Accepted || dialog.selectedPlacement() == -1) {
+        return;
+    }
+    const ScreenLabel::Placement &placement = placements.at(dialog.selectedPlacement());
+    // Switching screens goes through the spin box, like a user would
+    ui->screenNumberSpinBox->setValue(placement.screen + 1);
+    screenLabel->showPlacement(placement.cell, tileIndex);
+}
+
+void MainWindow::on_actionSeed_screens_triggered()
+{
+    Q_ASSERT(screenLabel != NULL);
+    Q_ASSERT(tileStore != NULL);
+    BuddyClusterer clusterer(tileStore, ScreenLabel::g_scorers[ScreenLabel::Autoplace]);
+    QVector<BuddyClusterer::Fragment> fragments;
+    const QString result = clusterer.run(&fragments);
+    if (result == "Cancelled") {
+        return;
+    }
+    if (!result.isEmpty()) {
+        displayMessage(result);
+        return;
+    }
+    int firstScreen = -1;
+    foreach (const BuddyClusterer::Fragment &fragment, fragments) {
+        const QString notes = "Seeded with " + QString::number(fragment.tiles.size()) + " tiles by best buddy analysis";
+        const int id = screenLabel->addScreen(fragment.tiles, fragment.positions, notes);
+        if (id == -1) {
+            break;
+        }
+        if (firstScreen == -1) {
+            firstScreen = id;
+        }
+    }
+    QMessageBox::information(this, "Seed screens", clusterer.report());
+    if (firstScreen != -1) {
+        ui->screenNumberSpinBox->setValue(firstScreen + 1);
+    }
+}
+
+void MainWindow::on_actionPNG_compression_level_triggered()
+{
+    bool ok;
+    int level = QInputDialog::getInt(
+                this,
+                "PNG compression level",
+                "Compression level for exported PNG images (0 = fastest, 9 = smallest):",
+                ScreenExporter::g_compressionLevel,
+                0, 9, 1, &ok);
+    if (ok) {
+        ScreenExporter::g_compressionLevel = level;
+    }
+}
@@ -22,8 +22,10 @@
 
 #include <QMainWindow>
 #include <QMessageBox>
+#include <QFutureWatcher>
 
 #include "screenlabel.h"
+#include "tileingestor.h"
 
 namespace Ui {
 class MainWindow;
@@ -42,8 +44,14 @@ public:
     // "Global" routine: Displays a message in an "OK" messagebox
     //
     static void displayMessage(const QString &message);
+    //
+    // "Global" routine: Shows a modal progress dialog until the future of
+    // watcher has finished. Returns false if the user cancelled it.
+    //
+    static bool runWithProgress(const QString &label, QFutureWatcherBase &watcher);
     void registerTileStore(TileStore *tileStore);
     void registerScreenLabel(ScreenLabel *screenLabel);
+    void registerTileIngestor(TileIngestor *tileIngestor);
 
     void closeEvent(QCloseEvent *event) override;
 
@@ -60,21 +68,42 @@ private:
     Ui::MainWindow *ui;
     TileStore *tileStore = NULL;
     ScreenLabel *screenLabel = NULL;
+    TileIngestor *tileIngestor = NULL;
     //
     // Remember path between dialogs
     //
     QString caseDialogPath;
 
     bool confirmIfModified(QString title);
+    //
+    // Replace the tile store by the tiles of a cache directory, or by an
+    // empty store if dir is empty
+    //
+    void newCase(QString dir);
+    void stopWatching();
 
 private slots:
     void on_actionNew_case_triggered();
+    void on_actionAdd_cache_directory_triggered();
+    void on_actionWatch_cache_directory_toggled(bool checked);
+    void on_actionRemove_cache_directory_triggered();
     void on_actionSave_case_as_triggered();
     void on_actionSave_case_triggered();
     void on_actionOpen_case_triggered();
     void on_actionExport_screen_images_triggered();
     void on_actionExit_triggered();
     void on_actionAbout_triggered();
+    void on_actionStatistics_triggered();
+    void on_actionTile_memory_limit_triggered();
+    void on_actionCompact_tile_encoding_toggled(bool checked);
+    void on_actionFast_edge_matching_toggled(bool checked);
+    void on_actionEdge_metric_benchmark_triggered();
+    void on_actionClustering_benchmark_triggered();
+    void on_actionEdge_scorers_triggered();
+    void on_actionBest_fit_overlay_toggled(bool checked);
+    void on_actionLocate_tile_triggered();
+    void on_actionSeed_screens_triggered();
+    void on_actionPNG_compression_level_triggered();
 
 };
 
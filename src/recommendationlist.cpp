@@ -0,0 +1,104 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "recommendationlist.h"
+
+#include <algorithm>
+
+const int RecommendationList::PAGE_SIZE = 64;
+
+RecommendationList::RecommendationList()
+    : isScored(false),
+      numRanked(0)
+{
+}
+
+void RecommendationList::clear()
+{
+    candidates.clear();
+    tiers.clear();
+    score = ScoreFunction();
+    isScored = false;
+    entries.clear();
+    numRanked = 0;
+}
+
+void RecommendationList::setCandidates(const QVector<int> &candidates, const QHash<int, int> &tiers, RecommendationList::ScoreFunction score)
+{
+    clear();
+    this->candidates = candidates;
+    this->tiers = tiers;
+    this->score = score;
+}
+
+int RecommendationList::size()
+{
+    scoreCandidates();
+    return entries.size();
+}
+
+QPair<double, int> RecommendationList::at(int rank)
+{
+    scoreCandidates();
+    while (rank >= numRanked && numRanked < entries.size()) {
+        rankNextPage();
+    }
+    const Entry &entry = entries.at(rank);
+    return QPair<double, int>(entry.score, entry.tileIndex);
+}
+
+bool RecommendationList::rankedBefore(const RecommendationList::Entry &a, const RecommendationList::Entry &b)
+{
+    if (a.tier != b.tier) {
+        return a.tier > b.tier;
+    }
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    return a.tileIndex < b.tileIndex;
+}
+
+void RecommendationList::scoreCandidates()
+{
+    if (isScored) {
+        return;
+    }
+    foreach (int tileIndex, candidates) {
+        Entry entry;
+        entry.score = score(tileIndex);
+        if (entry.score <= 0) {
+            continue;
+        }
+        entry.tileIndex = tileIndex;
+        entry.tier = tiers.value(tileIndex);
+        entries.append(entry);
+    }
+    // Scores are final, the inputs are no longer needed
+    candidates.clear();
+    tiers.clear();
+    score = ScoreFunction();
+    isScored = true;
+}
+
+void RecommendationList::rankNextPage()
+{
+    const int last = qMin(numRanked + PAGE_SIZE, entries.size());
+    std::partial_sort(entries.begin() + numRanked, entries.begin() + last, entries.end(), rankedBefore);
+    numRanked = last;
+}
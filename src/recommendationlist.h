@@ -0,0 +1,88 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECOMMENDATIONLIST_H
+#define RECOMMENDATIONLIST_H
+
+#include <QVector>
+#include <QPair>
+#include <QHash>
+#include <functional>
+
+//
+// Candidate tiles for a cell, ranked by tier first and score second.
+// Candidates are scored once, when the list is first needed. Ranking
+// happens one page at a time, as far as entries are actually requested:
+// each page is partially sorted out of the entries not ranked yet.
+//
+class RecommendationList
+{
+public:
+    //
+    // Number of entries ranked at once
+    //
+    static const int PAGE_SIZE;
+    //
+    // Match value of a candidate tile; values <= 0 are left out
+    //
+    typedef std::function<double(int tileIndex)> ScoreFunction;
+
+    RecommendationList();
+
+    void clear();
+    //
+    // Rank the given candidates; replaces any previous ones. Candidates with
+    // a higher tier are ranked ahead regardless of score.
+    //
+    void setCandidates(const QVector<int> &candidates, const QHash<int, int> &tiers, ScoreFunction score);
+    //
+    // Number of candidates scoring above zero; scores all candidates
+    //
+    int size();
+    //
+    // Return (score, tile index) of the entry at a rank, best first
+    //
+    QPair<double, int> at(int rank);
+
+private:
+    struct Entry {
+        double score;
+        int tileIndex;
+        int tier;
+    };
+
+    QVector<int> candidates;
+    QHash<int, int> tiers;
+    ScoreFunction score;
+    bool isScored;
+    //
+    // Scored entries; the first numRanked are in their final order
+    //
+    QVector<Entry> entries;
+    int numRanked;
+
+    void scoreCandidates();
+    void rankNextPage();
+    //
+    // Strict total order; equal scores are ranked by tile index
+    //
+    static bool rankedBefore(const Entry &a, const Entry &b);
+};
+
+#endif // RECOMMENDATIONLIST_H
@@ -20,21 +20,25 @@
 #include "recommendationslabel.h"
 
 #include <QPainter>
-#include <QMap>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <algorithm>
 
 const int RecommendationsLabel::CELL_MARGIN = 8;
-const int RecommendationsLabel::CELLS_MAX = 64;
 
 RecommendationsLabel::RecommendationsLabel(
         TileStore *tileStore,
-        QVector<QPair<double, int>> *recommendations
+        RecommendationList *recommendations
         )
     : tileStore(tileStore),
       recommendations(recommendations)
 {
+    setBackgroundRole(QPalette::Light);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    viewport()->setMouseTracking(true);
     tileStoreChanged();
     setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Preferred);
-    setMouseTracking(true);
 }
 
 void RecommendationsLabel::mouseMoveEvent(QMouseEvent *event)
@@ -42,11 +46,6 @@ void RecommendationsLabel::mouseMoveEvent(QMouseEvent *event)
     emit recommendationHover(calcRecommendedHoverIndex(event->pos()));
 }
 
-void RecommendationsLabel::leaveEvent(QEvent *)
-{
-    emit recommendationHover(-1);
-}
-
 void RecommendationsLabel::mousePressEvent(QMouseEvent *event)
 {
     int index = calcRecommendedHoverIndex(event->pos());
@@ -55,14 +54,41 @@ void RecommendationsLabel::mousePressEvent(QMouseEvent *event)
     }
 }
 
-void RecommendationsLabel::paintEvent(QPaintEvent *)
+void RecommendationsLabel::paintEvent(QPaintEvent *event)
 {
-    QPainter painter(this);
-    painter.setBackgroundMode(Qt::OpaqueMode);
-    for (int i = 0; i < std::min(recommendations->size(), CELLS_MAX); ++i) {
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), COL_BACK);
+    if (cellSize <= 0) {
+        return;
+    }
+    // Only cells intersecting the exposed area
+    const int offset = verticalScrollBar()->value();
+    const int first = std::max(0, (event->rect().top() + offset - CELL_MARGIN)/cellSize);
+    const int last = std::min(recommendations->size() - 1, (event->rect().bottom() + offset)/cellSize);
+    for (int i = first; i <= last; ++i) {
         const int index = recommendations->at(i).second;
-        painter.drawImage(CELL_MARGIN, CELL_MARGIN + i*cellSize, tileStore->getTile(index).getImage());
+        tileStore->drawTile(painter, CELL_MARGIN, CELL_MARGIN + i*cellSize - offset, index);
+    }
+}
+
+void RecommendationsLabel::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollRange();
+}
+
+void RecommendationsLabel::scrollContentsBy(int dx, int dy)
+{
+    // Move what has been painted already, only newly exposed cells are painted
+    viewport()->scroll(dx, dy);
+}
+
+bool RecommendationsLabel::viewportEvent(QEvent *event)
+{
+    if (event->type() == QEvent::Leave) {
+        emit recommendationHover(-1);
     }
+    return QAbstractScrollArea::viewportEvent(event);
 }
 
 int RecommendationsLabel::getCellSize() const
@@ -72,32 +98,38 @@ int RecommendationsLabel::getCellSize() const
 
 void RecommendationsLabel::recommendationsChanged()
 {
-    update();
+    updateScrollRange();
+    verticalScrollBar()->setValue(0);
+    viewport()->update();
 }
 
 void RecommendationsLabel::tileStoreChanged()
 {
     cellSize = tileStore->tileSize + 2*CELL_MARGIN;
-    resize(cellSize, CELLS_MAX*cellSize);
-    setPixmap(QPixmap::fromImage(QImage(cellSize, CELLS_MAX*cellSize, QImage::Format_ARGB32)));
-    setFixedWidth(cellSize);
-    update();
+    setFixedWidth(cellSize + verticalScrollBar()->sizeHint().width() + 2*frameWidth());
+    updateScrollRange();
+    viewport()->update();
+}
+
+void RecommendationsLabel::updateScrollRange()
+{
+    const int contentHeight = recommendations->size()*cellSize + CELL_MARGIN;
+    verticalScrollBar()->setRange(0, std::max(0, contentHeight - viewport()->height()));
+    verticalScrollBar()->setPageStep(viewport()->height());
+    verticalScrollBar()->setSingleStep(cellSize);
 }
 
 int RecommendationsLabel::calcRecommendedHoverIndex(QPoint pos)
 {
     int result = -1;
     const int x = pos.x();
-    const int y = pos.y();
-    if (x >= CELL_MARGIN && x < CELL_MARGIN + tileStore->tileSize
-            && y >= CELL_MARGIN && y < CELL_MARGIN + CELLS_MAX*cellSize) {
+    const int y = pos.y() + verticalScrollBar()->value();
+    if (x >= CELL_MARGIN && x < CELL_MARGIN + tileStore->tileSize && y >= CELL_MARGIN) {
         const int cell = (y - CELL_MARGIN)/cellSize;
         const int inCell = (y - CELL_MARGIN)%cellSize;
-        if (inCell >= CELL_MARGIN && inCell < CELL_MARGIN + tileStore->tileSize
-                && cell < recommendations->size()) {
+        if (inCell < tileStore->tileSize && cell < recommendations->size()) {
             result = recommendations->at(cell).second;
         }
     }
     return result;
 }
-
@@ -21,32 +21,35 @@
 #define BESTMATCHLABEL_H
 
 #include <QObject>
-#include <QLabel>
+#include <QAbstractScrollArea>
 
 #include "tilestore.h"
+#include "recommendationlist.h"
 
-class RecommendationsLabel : public QLabel
+//
+// Scrollable list of recommended tiles. Only the cells within the viewport
+// are painted, so any number of candidates can be shown.
+//
+class RecommendationsLabel : public QAbstractScrollArea
 {
     Q_OBJECT
 
 public:
     static const int CELL_MARGIN;
-    //
-    // Max number of best matches/hints to display
-    //
-    static const int CELLS_MAX;
 
     RecommendationsLabel(
             TileStore *tileStore,
-            QVector<QPair<double, int>> *recommendations
+            RecommendationList *recommendations
             );
 
     int getCellSize() const;
 
     void mouseMoveEvent(QMouseEvent *event) override;
-    void leaveEvent(QEvent *) override;
     void mousePressEvent(QMouseEvent *event) override;
-    void paintEvent(QPaintEvent *) override;
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    bool viewportEvent(QEvent *event) override;
 
 public slots:
     void recommendationsChanged();
@@ -59,9 +62,10 @@ signals:
 private:
     QColor COL_BACK = QColor("#ffffff");
     TileStore *tileStore;
-    QVector<QPair<double, int>> *recommendations;
+    RecommendationList *recommendations;
     int cellSize;
 
+    void updateScrollRange();
     int calcRecommendedHoverIndex(QPoint pos);
 };
 
@@ -0,0 +1,64 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "scorerdialog.h"
+#include "ui_scorerdialog.h"
+
+ScorerDialog::ScorerDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::ScorerDialog)
+{
+    ui->setupUi(this);
+    // Same order as Tile::Scorer
+    const QStringList scorers = QStringList()
+            << "Boundary colors (unfiltered)"
+            << "Boundary colors (Gauss 6)"
+            << "Boundary colors (Gauss 15)"
+            << "Gradient prediction (MGC)";
+    for (int operation = 0; operation < ScreenLabel::NUM_OPERATIONS; ++operation) {
+        comboBox(ScreenLabel::Operation(operation))->addItems(scorers);
+    }
+}
+
+ScorerDialog::~ScorerDialog()
+{
+    delete ui;
+}
+
+void ScorerDialog::setScorer(ScreenLabel::Operation operation, Tile::Scorer scorer)
+{
+    comboBox(operation)->setCurrentIndex(int(scorer));
+}
+
+Tile::Scorer ScorerDialog::getScorer(ScreenLabel::Operation operation)
+{
+    return Tile::Scorer(comboBox(operation)->currentIndex());
+}
+
+QComboBox *ScorerDialog::comboBox(ScreenLabel::Operation operation)
+{
+    switch (operation) {
+    case ScreenLabel::Heatmap:
+        return ui->heatmapComboBox;
+    case ScreenLabel::Recommendations:
+        return ui->recommendationsComboBox;
+    default:
+        return ui->autoplaceComboBox;
+    }
+}
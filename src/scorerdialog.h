@@ -0,0 +1,52 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCORERDIALOG_H
+#define SCORERDIALOG_H
+
+#include <QDialog>
+#include <QComboBox>
+
+#include "screenlabel.h"
+
+namespace Ui {
+class ScorerDialog;
+}
+
+//
+// Select the edge scorer for each operation
+//
+class ScorerDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ScorerDialog(QWidget *parent = 0);
+    ~ScorerDialog();
+
+    void setScorer(ScreenLabel::Operation operation, Tile::Scorer scorer);
+    Tile::Scorer getScorer(ScreenLabel::Operation operation);
+
+private:
+    Ui::ScorerDialog *ui;
+
+    QComboBox *comboBox(ScreenLabel::Operation operation);
+};
+
+#endif // SCORERDIALOG_H
@@ -0,0 +1,482 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "screenexporter.h"
+#include "mainwindow.h"
+
+#include <QImageWriter>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <QDir>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <string.h>
+#include <algorithm>
+
+QString ScreenExporter::g_format = "png";
+int ScreenExporter::g_compressionLevel = 6;
+const int ScreenExporter::MEMORY_BUDGET_MB = 1024;
+const int ScreenExporter::PYRAMID_TILE_SIZE = 256;
+
+static const quint32 PYRAMID_MANIFEST_MAGIC = 0x52435351;   // "RCSQ"
+// Manifests written before tiles were compared by pixel digest
+static const quint32 PYRAMID_MANIFEST_MAGIC_V1 = 0x52435350;   // "RCSP"
+static const char *PYRAMID_MANIFEST_NAME = "manifest.dat";
+
+ScreenExporter::ScreenExporter(TileStore *tileStore) :
+    tileStore(tileStore),
+    memoryBudget(MEMORY_BUDGET_MB)
+{
+}
+
+void ScreenExporter::addScreen(const QVector<QVector<int>> &screen, const QString &filename)
+{
+    Job job;
+    job.screen = screen;
+    job.filename = filename;
+    // Determine image boundaries
+    job.top = 999999;
+    job.left = 999999;
+    for (int row = 0; row < screen.size(); ++row) {
+        const QVector<int> &tileRow = screen.at(row);
+        for (int col = 0; col < tileRow.size(); ++col) {
+            if (tileRow.at(col) >= 0) {
+                job.top = std::min(row, job.top);
+                job.right = std::max(col, job.right);
+                job.bottom = std::max(row, job.bottom);
+                job.left = std::min(col, job.left);
+            }
+        }
+    }
+    if (job.bottom >= 0) {
+        jobs.append(job);
+    }
+}
+
+QString ScreenExporter::run()
+{
+    if (g_format == "dzi") {
+        return runPyramids();
+    }
+    QFutureWatcher<void> watcher;
+    watcher.setFuture(QtConcurrent::map(jobs, [this](Job &job) {
+        exportJob(job);
+    }));
+    if (!MainWindow::runWithProgress("Exporting screens...", watcher)) {
+        return "Cancelled";
+    }
+    foreach (const Job &job, jobs) {
+        if (!job.error.isEmpty()) {
+            return job.error;
+        }
+    }
+    return "";
+}
+
+void ScreenExporter::exportJob(Job &job)
+{
+    bool success;
+    if (g_format == "bmp") {
+        success = writeBmp(job);
+    } else {
+        success = writeImage(job);
+    }
+    if (!success) {
+        job.error = "Unable to save image " + job.filename + "!";
+    }
+}
+
+void ScreenExporter::composeRows(const Job &job, int firstRow, int numRows, QImage *target)
+{
+    const int tileSize = tileStore->tileSize;
+    target->fill(Qt::GlobalColor::transparent);
+    for (int row = firstRow; row < firstRow + numRows; ++row) {
+        const QVector<int> &tileRow = job.screen.at(job.top + row);
+        const int yOffset = (row - firstRow)*tileSize;
+        for (int col = job.left; col <= job.right; ++col) {
+            const int tileIndex = tileRow.at(col);
+            if (tileIndex < 0) {
+                continue;
+            }
+            QImage image = tileStore->getImage(tileIndex);
+            if (image.format() != QImage::Format_ARGB32 && image.format() != QImage::Format_RGB32) {
+                image = image.convertToFormat(QImage::Format_ARGB32);
+            }
+            const int xOffset = (col - job.left)*tileSize;
+            const int copyWidth = std::min(image.width(), tileSize);
+            const int copyHeight = std::min(image.height(), tileSize);
+            for (int y = 0; y < copyHeight; ++y) {
+                memcpy(target->scanLine(yOffset + y) + xOffset*4, image.constScanLine(y), copyWidth*4);
+            }
+        }
+    }
+}
+
+bool ScreenExporter::writeImage(const Job &job)
+{
+    const int tileSize = tileStore->tileSize;
+    const int numRows = job.bottom - job.top + 1;
+    const int width = (job.right - job.left + 1)*tileSize;
+    const int height = numRows*tileSize;
+    const int units = acquireMemory(qint64(width)*height*4);
+    QImage image(width, height, QImage::Format_ARGB32);
+    bool success = !image.isNull();
+    if (success) {
+        composeRows(job, 0, numRows, &image);
+        QImageWriter writer(job.filename, g_format.toLatin1());
+        if (g_format == "png") {
+            // Qt maps quality [0, 100] to zlib compression [9, 0]
+            writer.setQuality(100 - (g_compressionLevel*91 + 8)/9);
+        }
+        success = writer.write(image);
+    }
+    memoryBudget.release(units);
+    return success;
+}
+
+bool ScreenExporter::writeBmp(const Job &job)
+{
+    const int tileSize = tileStore->tileSize;
+    const int width = (job.right - job.left + 1)*tileSize;
+    const int height = (job.bottom - job.top + 1)*tileSize;
+    const quint32 imageSize = quint32(width)*quint32(height)*4;
+    QFile file(job.filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    // BITMAPFILEHEADER and BITMAPINFOHEADER, 32 bit top-down
+    uchar header[54];
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    qToLittleEndian<quint32>(54 + imageSize, header + 2);
+    qToLittleEndian<quint32>(54, header + 10);
+    qToLittleEndian<quint32>(40, header + 14);
+    qToLittleEndian<qint32>(width, header + 18);
+    qToLittleEndian<qint32>(-height, header + 22);
+    qToLittleEndian<quint16>(1, header + 26);
+    qToLittleEndian<quint16>(32, header + 28);
+    qToLittleEndian<quint32>(imageSize, header + 34);
+    qToLittleEndian<qint32>(2835, header + 38);
+    qToLittleEndian<qint32>(2835, header + 42);
+    if (file.write(reinterpret_cast<const char *>(header), sizeof(header)) != qint64(sizeof(header))) {
+        return false;
+    }
+    const int units = acquireMemory(qint64(width)*tileSize*4);
+    QImage band(width, tileSize, QImage::Format_ARGB32);
+    bool success = !band.isNull();
+    for (int row = 0; success && row <= job.bottom - job.top; ++row) {
+        composeRows(job, row, 1, &band);
+        for (int y = 0; success && y < tileSize; ++y) {
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+            QRgb *line = reinterpret_cast<QRgb *>(band.scanLine(y));
+            for (int x = 0; x < width; ++x) {
+                line[x] = qToLittleEndian(line[x]);
+            }
+#endif
+            success = (file.write(reinterpret_cast<const char *>(band.constScanLine(y)), width*4) == width*4);
+        }
+    }
+    memoryBudget.release(units);
+    return success;
+}
+
+int ScreenExporter::acquireMemory(qint64 bytes)
+{
+    const int units = int(std::min<qint64>(MEMORY_BUDGET_MB, std::max<qint64>(1, bytes/(1024*1024))));
+    memoryBudget.acquire(units);
+    return units;
+}
+
+QString ScreenExporter::runPyramids()
+{
+    // Collect dirty pyramid tiles of all screens, grouped by distance from the
+    // full resolution level. Each level is built from the one above it.
+    QVector<QVector<PyramidTile>> stages;
+    for (int j = 0; j < jobs.size(); ++j) {
+        QVector<PyramidTile> dirty;
+        QString result = preparePyramid(j, &dirty);
+        if (!result.isEmpty()) {
+            return result;
+        }
+        // Until all tiles are in place, neither the descriptor nor the manifest
+        // may describe them. An empty manifest still marks the directory as ours.
+        const Job &job = jobs.at(j);
+        if (QFile::exists(job.filename) && !QFile::remove(job.filename)) {
+            return "Unable to replace " + job.filename + "!";
+        }
+        if (!writeManifest(job, QHash<QString, QByteArray>())) {
+            return "Unable to write pyramid manifest!";
+        }
+        foreach (const PyramidTile &tile, dirty) {
+            const int stage = jobs.at(j).maxLevel - tile.level;
+            if (stages.size() <= stage) {
+                stages.resize(stage + 1);
+            }
+            stages[stage].append(tile);
+        }
+    }
+    for (int stage = 0; stage < stages.size(); ++stage) {
+        QVector<PyramidTile> &tiles = stages[stage];
+        if (tiles.isEmpty()) {
+            continue;
+        }
+        QFutureWatcher<void> watcher;
+        watcher.setFuture(QtConcurrent::map(tiles, [this](PyramidTile &tile) {
+            tile.success = writePyramidTile(jobs.at(tile.job), tile.level, tile.col, tile.row);
+        }));
+        if (!MainWindow::runWithProgress("Writing image pyramids (level " + QString::number(stage + 1) + ")...", watcher)) {
+            return "Cancelled";
+        }
+        foreach (const PyramidTile &tile, tiles) {
+            if (!tile.success) {
+                return "Unable to save image " + pyramidTilePath(jobs.at(tile.job), tile.level, tile.col, tile.row) + "!";
+            }
+        }
+    }
+    // Descriptors and manifests are only written once all tiles are in place
+    foreach (const Job &job, jobs) {
+        QFile dzi(job.filename);
+        if (!dzi.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return "Unable to write " + job.filename + "!";
+        }
+        QString xml = QString("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+                + "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" TileSize=\""
+                + QString::number(PYRAMID_TILE_SIZE) + "\">\n"
+                + "  <Size Width=\"" + QString::number(job.width) + "\" Height=\"" + QString::number(job.height) + "\"/>\n"
+                + "</Image>\n";
+        const QByteArray data = xml.toUtf8();
+        if (dzi.write(data) != data.size() || !dzi.flush()) {
+            return "Unable to write " + job.filename + "!";
+        }
+        dzi.close();
+        if (!writeManifest(job, job.signatures)) {
+            return "Unable to write pyramid manifest!";
+        }
+    }
+    return "";
+}
+
+bool ScreenExporter::writeManifest(const Job &job, const QHash<QString, QByteArray> &signatures)
+{
+    QFile manifest(job.filesDir + "/" + PYRAMID_MANIFEST_NAME);
+    if (!manifest.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    QDataStream out(&manifest);
+    out.setVersion(QDataStream::Qt_5_9);
+    out << PYRAMID_MANIFEST_MAGIC;
+    out << (qint32)job.width << (qint32)job.height << (qint32)tileStore->tileSize;
+    out << storeIdentity();
+    out << signatures;
+    return out.status() == QDataStream::Ok && manifest.flush();
+}
+
+QString ScreenExporter::preparePyramid(int jobIndex, QVector<PyramidTile> *dirty)
+{
+    Job &job = jobs[jobIndex];
+    const int tileSize = tileStore->tileSize;
+    job.width = (job.right - job.left + 1)*tileSize;
+    job.height = (job.bottom - job.top + 1)*tileSize;
+    job.maxLevel = 0;
+    while ((1 << job.maxLevel) < std::max(job.width, job.height)) {
+        job.maxLevel++;
+    }
+    QString base = job.filename;
+    if (base.endsWith(".dzi")) {
+        base.truncate(base.length() - 4);
+    }
+    job.filesDir = base + "_files";
+    // Signatures of the last export, if its geometry and store still match
+    QHash<QString, QByteArray> previous;
+    bool isPyramidDir = false;
+    QFile manifest(job.filesDir + "/" + PYRAMID_MANIFEST_NAME);
+    if (manifest.open(QIODevice::ReadOnly)) {
+        QDataStream in(&manifest);
+        in.setVersion(QDataStream::Qt_5_9);
+        quint32 magic;
+        qint32 width, height, prevTileSize;
+        in >> magic >> width >> height >> prevTileSize;
+        isPyramidDir = (in.status() == QDataStream::Ok
+                        && (magic == PYRAMID_MANIFEST_MAGIC || magic == PYRAMID_MANIFEST_MAGIC_V1));
+        if (isPyramidDir && magic == PYRAMID_MANIFEST_MAGIC
+                && width == job.width && height == job.height && prevTileSize == tileSize) {
+            QByteArray identity;
+            in >> identity;
+            if (in.status() == QDataStream::Ok && identity == storeIdentity()) {
+                in >> previous;
+            }
+            if (in.status() != QDataStream::Ok) {
+                previous.clear();
+            }
+        }
+        manifest.close();
+    }
+    if (previous.isEmpty()) {
+        // New or resized canvas: start from scratch to drop stale tiles, but
+        // never delete a directory this exporter has not written
+        QDir dir(job.filesDir);
+        if (isPyramidDir) {
+            if (!dir.removeRecursively()) {
+                return "Unable to remove the previous pyramid in " + job.filesDir + "!";
+            }
+        } else if (dir.exists() && !dir.isEmpty()) {
+            return "Directory " + job.filesDir + " already exists and does not contain an exported pyramid!";
+        }
+    }
+    for (int level = job.maxLevel; level >= 0; --level) {
+        if (!QDir().mkpath(job.filesDir + "/" + QString::number(level))) {
+            return "Unable to create directory " + job.filesDir + "!";
+        }
+        const int scale = 1 << (job.maxLevel - level);
+        const int levelWidth = (job.width + scale - 1)/scale;
+        const int levelHeight = (job.height + scale - 1)/scale;
+        const int numCols = (levelWidth + PYRAMID_TILE_SIZE - 1)/PYRAMID_TILE_SIZE;
+        const int numRows = (levelHeight + PYRAMID_TILE_SIZE - 1)/PYRAMID_TILE_SIZE;
+        for (int row = 0; row < numRows; ++row) {
+            for (int col = 0; col < numCols; ++col) {
+                const QString key = QString::number(level) + "/" + QString::number(col) + "_" + QString::number(row);
+                const QByteArray signature = pyramidSignature(job, level, col, row);
+                job.signatures.insert(key, signature);
+                if (!previous.contains(key) || previous.value(key) != signature
+                        || !QFile::exists(pyramidTilePath(job, level, col, row))) {
+                    PyramidTile tile;
+                    tile.job = jobIndex;
+                    tile.level = level;
+                    tile.col = col;
+                    tile.row = row;
+                    tile.success = false;
+                    dirty->append(tile);
+                }
+            }
+        }
+    }
+    return "";
+}
+
+QByteArray ScreenExporter::pyramidSignature(const Job &job, int level, int col, int row)
+{
+    // Digest over the pixel digests of all covered screen cells, so a tile
+    // index that now refers to different pixels is detected
+    const int tileSize = tileStore->tileSize;
+    const QRect rect = pyramidTileRect(job, level, col, row);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    for (int cellRow = rect.top()/tileSize; cellRow <= rect.bottom()/tileSize; ++cellRow) {
+        const QVector<int> &tileRow = job.screen.at(job.top + cellRow);
+        for (int cellCol = rect.left()/tileSize; cellCol <= rect.right()/tileSize; ++cellCol) {
+            const int tileIndex = tileRow.at(job.left + cellCol);
+            const QByteArray digest = (tileIndex >= 0) ? tileStore->getTileHash(tileIndex) : QByteArray();
+            // Length prefix keeps empty cells apart from tiles
+            const char length = char(digest.size());
+            hash.addData(&length, 1);
+            hash.addData(digest);
+        }
+    }
+    return hash.result().left(16);
+}
+
+QByteArray ScreenExporter::storeIdentity() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(tileStore->name.toUtf8());
+    for (int source = 0; source < tileStore->numSources(); ++source) {
+        hash.addData("\n", 1);
+        hash.addData(tileStore->sourceName(source).toUtf8());
+    }
+    return hash.result().left(16);
+}
+
+QRect ScreenExporter::pyramidTileRect(const Job &job, int level, int col, int row)
+{
+    const int scale = 1 << (job.maxLevel - level);
+    const int x = col*PYRAMID_TILE_SIZE*scale;
+    const int y = row*PYRAMID_TILE_SIZE*scale;
+    const int width = std::min(PYRAMID_TILE_SIZE*scale, job.width - x);
+    const int height = std::min(PYRAMID_TILE_SIZE*scale, job.height - y);
+    return QRect(x, y, width, height);
+}
+
+QString ScreenExporter::pyramidTilePath(const Job &job, int level, int col, int row)
+{
+    return job.filesDir + "/" + QString::number(level) + "/"
+            + QString::number(col) + "_" + QString::number(row) + ".png";
+}
+
+bool ScreenExporter::writePyramidTile(const Job &job, int level, int col, int row)
+{
+    const int tileSize = tileStore->tileSize;
+    const int scale = 1 << (job.maxLevel - level);
+    const QRect rect = pyramidTileRect(job, level, col, row);
+    const int width = (rect.width() + scale - 1)/scale;
+    const int height = (rect.height() + scale - 1)/scale;
+    QImage image;
+    if (level == job.maxLevel) {
+        // Copy overlapping parts of the screen cells directly
+        image = QImage(width, height, QImage::Format_ARGB32);
+        image.fill(Qt::GlobalColor::transparent);
+        for (int cellRow = rect.top()/tileSize; cellRow <= rect.bottom()/tileSize; ++cellRow) {
+            for (int cellCol = rect.left()/tileSize; cellCol <= rect.right()/tileSize; ++cellCol) {
+                const int tileIndex = job.screen.at(job.top + cellRow).at(job.left + cellCol);
+                if (tileIndex < 0) {
+                    continue;
+                }
+                QImage tileImage = tileStore->getImage(tileIndex);
+                if (tileImage.format() != QImage::Format_ARGB32 && tileImage.format() != QImage::Format_RGB32) {
+                    tileImage = tileImage.convertToFormat(QImage::Format_ARGB32);
+                }
+                const QRect cellRect(cellCol*tileSize, cellRow*tileSize,
+                                     std::min(tileImage.width(), tileSize), std::min(tileImage.height(), tileSize));
+                const QRect overlap = cellRect.intersected(rect);
+                for (int y = overlap.top(); y <= overlap.bottom(); ++y) {
+                    memcpy(image.scanLine(y - rect.top()) + (overlap.left() - rect.left())*4,
+                           tileImage.constScanLine(y - cellRect.top()) + (overlap.left() - cellRect.left())*4,
+                           overlap.width()*4);
+                }
+            }
+        }
+    } else {
+        // Downscale the (up to) four children of the next finer level
+        const int childScale = scale/2;
+        QImage children((rect.width() + childScale - 1)/childScale, (rect.height() + childScale - 1)/childScale, QImage::Format_ARGB32);
+        children.fill(Qt::GlobalColor::transparent);
+        for (int childRow = 0; childRow < 2; ++childRow) {
+            for (int childCol = 0; childCol < 2; ++childCol) {
+                QImage child(pyramidTilePath(job, level + 1, 2*col + childCol, 2*row + childRow));
+                if (child.isNull()) {
+                    continue;
+                }
+                if (child.format() != QImage::Format_ARGB32) {
+                    child = child.convertToFormat(QImage::Format_ARGB32);
+                }
+                const int xOffset = childCol*PYRAMID_TILE_SIZE;
+                const int yOffset = childRow*PYRAMID_TILE_SIZE;
+                const int copyWidth = std::min(child.width(), children.width() - xOffset);
+                const int copyHeight = std::min(child.height(), children.height() - yOffset);
+                for (int y = 0; y < copyHeight; ++y) {
+                    memcpy(children.scanLine(yOffset + y) + xOffset*4, child.constScanLine(y), copyWidth*4);
+                }
+            }
+        }
+        image = children.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    QImageWriter writer(pyramidTilePath(job, level, col, row), "png");
+    writer.setQuality(100 - (g_compressionLevel*91 + 8)/9);
+    return writer.write(image);
+}
@@ -0,0 +1,130 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCREENEXPORTER_H
+#define SCREENEXPORTER_H
+
+#include <QString>
+#include <QImage>
+#include <QVector>
+#include <QSemaphore>
+#include <QFile>
+#include <QHash>
+#include <QRect>
+
+#include "tilestore.h"
+
+//
+// Writes cropped screen images concurrently on the global thread pool.
+// Tiles are composed by copying their rows directly into the target raster.
+// Alternatively, each screen is written as a Deep Zoom (DZI) image pyramid,
+// rewriting only pyramid tiles whose content changed since the last export.
+// Pyramid tiles are compared by the pixel digests of the tiles they cover,
+// and only within the same case and sources.
+//
+class ScreenExporter
+{
+public:
+    //
+    // Image format ("png", "bmp" or "dzi") and PNG compression level (0-9)
+    //
+    static QString g_format;
+    static int g_compressionLevel;
+    //
+    // Edge length of Deep Zoom pyramid tiles in pixels
+    //
+    static const int PYRAMID_TILE_SIZE;
+    //
+    // Upper bound for raster memory of all exports in flight, in megabytes
+    //
+    static const int MEMORY_BUDGET_MB;
+
+    ScreenExporter(TileStore *tileStore);
+
+    //
+    // Queue a screen for export; empty cells are left transparent
+    //
+    void addScreen(const QVector<QVector<int>> &screen, const QString &filename);
+    //
+    // Export all queued screens. Returns an error message or an empty string.
+    //
+    QString run();
+
+private:
+    struct Job {
+        QVector<QVector<int>> screen;
+        QString filename;
+        int top = 0;
+        int left = 0;
+        int bottom = -1;
+        int right = -1;
+        QString error;
+        //
+        // Deep Zoom pyramid state
+        //
+        int width = 0;
+        int height = 0;
+        int maxLevel = 0;
+        QString filesDir;
+        QHash<QString, QByteArray> signatures;
+    };
+    struct PyramidTile {
+        int job;
+        int level;
+        int col;
+        int row;
+        bool success;
+    };
+
+    TileStore *tileStore;
+    QVector<Job> jobs;
+    QSemaphore memoryBudget;
+
+    void exportJob(Job &job);
+    //
+    // Compose tile rows [firstRow, firstRow + numRows) of the cropped screen
+    //
+    void composeRows(const Job &job, int firstRow, int numRows, QImage *target);
+    bool writeImage(const Job &job);
+    //
+    // BMP files are written band by band, so only one row of tiles is held in memory
+    //
+    bool writeBmp(const Job &job);
+    int acquireMemory(qint64 bytes);
+
+    QString runPyramids();
+    //
+    // Determine pyramid geometry and collect tiles that need to be (re)written
+    //
+    QString preparePyramid(int jobIndex, QVector<PyramidTile> *dirty);
+    QByteArray pyramidSignature(const Job &job, int level, int col, int row);
+    //
+    // Case file and cache directories the store was built from
+    //
+    QByteArray storeIdentity() const;
+    bool writeManifest(const Job &job, const QHash<QString, QByteArray> &signatures);
+    bool writePyramidTile(const Job &job, int level, int col, int row);
+    //
+    // Full resolution pixel rect covered by a pyramid tile
+    //
+    QRect pyramidTileRect(const Job &job, int level, int col, int row);
+    static QString pyramidTilePath(const Job &job, int level, int col, int row);
+};
+
+#endif // SCREENEXPORTER_H
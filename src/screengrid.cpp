@@ -0,0 +1,149 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "screengrid.h"
+
+int ScreenGrid::at(int col, int row) const
+{
+    const int chunkCol = chunkCoord(col);
+    const int chunkRow = chunkCoord(row);
+    auto it = chunks.constFind(chunkKey(chunkCol, chunkRow));
+    if (it == chunks.constEnd()) {
+        return EMPTY;
+    }
+    const int x = col - chunkCol*CHUNK_SIZE;
+    const int y = row - chunkRow*CHUNK_SIZE;
+    return it->cells.at(y*CHUNK_SIZE + x);
+}
+
+void ScreenGrid::set(int col, int row, int tileIndex)
+{
+    if (tileIndex < 0 && tileIndex != LOCKED) {
+        tileIndex = EMPTY;
+    }
+    const int chunkCol = chunkCoord(col);
+    const int chunkRow = chunkCoord(row);
+    const quint64 key = chunkKey(chunkCol, chunkRow);
+    auto it = chunks.find(key);
+    if (it == chunks.end()) {
+        if (tileIndex == EMPTY) {
+            return;
+        }
+        Chunk chunk;
+        chunk.cells.fill(EMPTY, CHUNK_SIZE*CHUNK_SIZE);
+        it = chunks.insert(key, chunk);
+    }
+    Chunk &chunk = *it;
+    int &cell = chunk.cells[(row - chunkRow*CHUNK_SIZE)*CHUNK_SIZE + (col - chunkCol*CHUNK_SIZE)];
+    if (cell == LOCKED && tileIndex >= 0) {
+        return;
+    }
+    if (cell == EMPTY && tileIndex != EMPTY) {
+        chunk.numUsed++;
+        chunk.bounds = chunk.bounds.united(QRect(col, row, 1, 1));
+    } else if (cell != EMPTY && tileIndex == EMPTY) {
+        chunk.numUsed--;
+        if (chunk.numUsed == 0) {
+            chunks.erase(it);
+            return;
+        }
+        cell = EMPTY;
+        // Only clearing a cell on the border can shrink the chunk's bounds
+        if (col == chunk.bounds.left() || col == chunk.bounds.right()
+                || row == chunk.bounds.top() || row == chunk.bounds.bottom()) {
+            updateBounds(chunk, chunkCol, chunkRow);
+        }
+        return;
+    }
+    cell = tileIndex;
+}
+
+bool ScreenGrid::isEmpty() const
+{
+    return chunks.isEmpty();
+}
+
+int ScreenGrid::numTiles() const
+{
+    int result = 0;
+    for (auto it = chunks.constBegin(); it != chunks.constEnd(); ++it) {
+        result += it->numUsed;
+    }
+    return result;
+}
+
+QRect ScreenGrid::bounds() const
+{
+    QRect result;
+    for (auto it = chunks.constBegin(); it != chunks.constEnd(); ++it) {
+        result = result.united(it->bounds);
+    }
+    return result;
+}
+
+QVector<QVector<int>> ScreenGrid::toDense(const QRect &rect) const
+{
+    QVector<QVector<int>> rows;
+    rows.reserve(rect.height());
+    for (int row = rect.top(); row <= rect.bottom(); ++row) {
+        QVector<int> denseRow(rect.width(), EMPTY);
+        for (int col = rect.left(); col <= rect.right(); ++col) {
+            denseRow[col - rect.left()] = at(col, row);
+        }
+        rows.append(denseRow);
+    }
+    return rows;
+}
+
+ScreenGrid ScreenGrid::fromDense(const QVector<QVector<int>> &rows)
+{
+    ScreenGrid grid;
+    for (int row = 0; row < rows.size(); ++row) {
+        const QVector<int> &denseRow = rows.at(row);
+        for (int col = 0; col < denseRow.size(); ++col) {
+            if (denseRow.at(col) != EMPTY) {
+                grid.set(col, row, denseRow.at(col));
+            }
+        }
+    }
+    return grid;
+}
+
+int ScreenGrid::chunkCoord(int cellCoord)
+{
+    // Round towards negative infinity
+    return (cellCoord >= 0) ? cellCoord/CHUNK_SIZE : -((-cellCoord + CHUNK_SIZE - 1)/CHUNK_SIZE);
+}
+
+quint64 ScreenGrid::chunkKey(int chunkCol, int chunkRow)
+{
+    return (quint64(quint32(chunkCol)) << 32) | quint32(chunkRow);
+}
+
+void ScreenGrid::updateBounds(Chunk &chunk, int chunkCol, int chunkRow)
+{
+    chunk.bounds = QRect();
+    for (int y = 0; y < CHUNK_SIZE; ++y) {
+        for (int x = 0; x < CHUNK_SIZE; ++x) {
+            if (chunk.cells.at(y*CHUNK_SIZE + x) != EMPTY) {
+                chunk.bounds = chunk.bounds.united(QRect(chunkCol*CHUNK_SIZE + x, chunkRow*CHUNK_SIZE + y, 1, 1));
+            }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCREENGRID_H
+#define SCREENGRID_H
+
+#include <QHash>
+#include <QVector>
+#include <QRect>
+
+//
+// Sparse, unbounded grid of tile indices with signed cell coordinates.
+// Cells are kept in fixed-size chunks, which are only allocated while they
+// contain at least one tile, so the grid can grow in any direction without
+// moving existing cells.
+//
+class ScreenGrid
+{
+public:
+    static const int CHUNK_SIZE = 16;
+    static const int EMPTY = -1;
+    //
+    // Marks a cell that must not receive a tile; kept like a tile, so it is
+    // part of the bounds and saved with the screen
+    //
+    static const int LOCKED = -2;
+
+    //
+    // Return tile index in a cell, EMPTY or LOCKED
+    //
+    int at(int col, int row) const;
+    //
+    // Store a tile index, EMPTY or LOCKED. Storing a tile index in a locked
+    // cell keeps the lock; only EMPTY releases it.
+    //
+    void set(int col, int row, int tileIndex);
+    bool isEmpty() const;
+    int numTiles() const;
+    //
+    // Bounding rectangle of all non-empty cells; null if the grid is empty
+    //
+    QRect bounds() const;
+    //
+    // Dense rows of the cells within rect, as stored in case files
+    //
+    QVector<QVector<int>> toDense(const QRect &rect) const;
+    static ScreenGrid fromDense(const QVector<QVector<int>> &rows);
+
+private:
+    struct Chunk {
+        QVector<int> cells;
+        int numUsed = 0;
+        //
+        // Bounding rectangle of the chunk's non-empty cells, in grid coordinates
+        //
+        QRect bounds;
+    };
+
+    QHash<quint64, Chunk> chunks;
+
+    static int chunkCoord(int cellCoord);
+    static quint64 chunkKey(int chunkCol, int chunkRow);
+    static void updateBounds(Chunk &chunk, int chunkCol, int chunkRow);
+};
+
+#endif // SCREENGRID_H
@@ -19,28 +19,45 @@
 
 #include "screenlabel.h"
 #include "notesdialog.h"
+#include "screenexporter.h"
+#include "mainwindow.h"
 
 #include <QPainter>
 #include <math.h>
 #include <QProgressDialog>
 #include <QApplication>
 #include <QPlainTextEdit>
+#include <QSaveFile>
+#include <QElapsedTimer>
+#include <QScrollArea>
+#include <QScrollBar>
+#include <QtConcurrent>
+#include <algorithm>
 
 const int ScreenLabel::SCREEN_DEFAULT_WIDTH = 20;
 const int ScreenLabel::SCREEN_DEFAULT_HEIGHT = 16;
-const int ScreenLabel::SCREENSTORE_SIZE = 99;
+const int ScreenLabel::MAX_SCREENS = 999999;
 const int ScreenLabel::CELL_EMPTY = -1;
-const int ScreenLabel::CELL_LOCKED = -2;
+const int ScreenLabel::CELL_LOCKED = ScreenGrid::LOCKED;
 const double ScreenLabel::MATCH_EMPTY = -1;
+const int ScreenLabel::MIN_SPARE_CELLS = 8;
+const int ScreenLabel::MAX_ZOOM_LEVEL = TileMipmaps::MAX_LEVEL;
+
+const int ScreenLabel::MAX_PLACEMENTS = 100;
+
+const int ScreenLabel::TIER_QUANTIZED = 1;
+const int ScreenLabel::TIER_EXACT = 2;
 
 const int ScreenLabel::HEURISTIC_MAX_STORE_DISTANCE = 40;
 const double ScreenLabel::HEURISTIC_RESIZED_FACTOR = 0.5;
 double ScreenLabel::g_heurStoreDistanceWeight = 0.1;
 double ScreenLabel::g_heurColorsThreshold = 0.08;
 double ScreenLabel::g_heurColorsWeight = 0.4;
+const double ScreenLabel::BEST_FIT_OPACITY = 0.5;
+Tile::Scorer ScreenLabel::g_scorers[NUM_OPERATIONS] = {Tile::ColorsGauss15, Tile::ColorsGauss15, Tile::ColorsGauss15};
 
 const QString ScreenLabel::CASEFILE_MAGIC("RCS_CASE");
-const int ScreenLabel::CASEFILE_VERSION = 2;
+const int ScreenLabel::CASEFILE_VERSION = 5;
 
 ScreenLabel::ScreenLabel(TileStore *tileStore, TileStoreWidget *tileStoreWidget)
     : tileStore(tileStore),
@@ -50,7 +67,9 @@ ScreenLabel::ScreenLabel(TileStore *tileStore, TileStoreWidget *tileStoreWidget)
       curScreenWidth(tileStore->tileSize * SCREEN_DEFAULT_WIDTH + 2*MARGIN),
       curScreenHeight(tileStore->tileSize * SCREEN_DEFAULT_HEIGHT + 2*MARGIN),
       recommendationIndex(-1),
-      curScreen(0)
+      curScreen(0),
+      screen(NULL),
+      bestFits(tileStore)
 {
     setMouseTracking(true);
     initScreens();
@@ -60,16 +79,28 @@ ScreenLabel::ScreenLabel(TileStore *tileStore, TileStoreWidget *tileStoreWidget)
     notesGeometry = notes.geometry();
 }
 
+ScreenLabel::~ScreenLabel()
+{
+    clearScreens();
+}
+
 void ScreenLabel::mouseMoveEvent(QMouseEvent *event)
 {
+    const QPoint oldGridPos = mouseGridPos();
     mousePos = event->pos();
-    update();
+    const QPoint newGridPos = mouseGridPos();
+    // Only the hover preview depends on the mouse position
+    if (newGridPos != oldGridPos && tileStoreWidget->selectedIndex() != -1) {
+        updateCell(oldGridPos);
+        updateCell(newGridPos);
+    }
 }
 
 void ScreenLabel::leaveEvent(QEvent *)
 {
+    const QPoint oldGridPos = mouseGridPos();
     mousePos.setX(-1);
-    update();
+    updateCell(oldGridPos);
 }
 
 void ScreenLabel::mousePressEvent(QMouseEvent *event)
@@ -81,29 +112,30 @@ void ScreenLabel::mousePressEvent(QMouseEvent *event)
             if (gridPos.x() != -1) {
                 placeTile(gridPos.x(), gridPos.y(), tileStoreWidget->selectedIndex());
                 tileStoreWidget->clearSelection();
-                update();
             }
         } else {
             // Select screen tile for recommendations
             QPoint gridPos = mouseGridPos();
-            if (gridPos.x() != -1 && screenTileRows.at(gridPos.y()).at(gridPos.x()) == CELL_EMPTY) {
+            if (gridPos.x() != -1 && cellAt(gridPos.x(), gridPos.y()) == CELL_EMPTY) {
+                updateCell(selectedPos);
                 selectedPos.setX(gridPos.x());
                 selectedPos.setY(gridPos.y());
                 updateRecommendations();
-                update();
+                updateCell(selectedPos);
             }
         }
     } else if (event->button() == Qt::MiddleButton) {
         // Auto-place best recommendation here
         QPoint gridPos = mouseGridPos();
-        if (gridPos.x() != -1 && screenTileRows.at(gridPos.y()).at(gridPos.x()) == CELL_EMPTY) {
+        if (gridPos.x() != -1 && cellAt(gridPos.x(), gridPos.y()) == CELL_EMPTY) {
+            updateCell(selectedPos);
             selectedPos.setX(gridPos.x());
             selectedPos.setY(gridPos.y());
             updateRecommendations();
+            updateCell(selectedPos);
             if (recommendations.size() > 0 && recommendations.at(0).first > 0) {
                 int tileIndex = recommendations.at(0).second;
                 placeRecommendation(tileIndex);
-                update();
             }
         }
     } else if (event->button() == Qt::RightButton) {
@@ -112,76 +144,386 @@ void ScreenLabel::mousePressEvent(QMouseEvent *event)
         int yPos = gridPos.y();
         if (xPos != -1) {
             int erasedIndex = clearCell(xPos, yPos);
-            emit availableTilesChanged();
             tileStoreWidget->selectTile(erasedIndex);
-            updateMatchValues();
-            updateRecommendations();
-            update();
         }
     }
 }
 
-void ScreenLabel::paintEvent(QPaintEvent *)
+void ScreenLabel::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton || !bestFits.isEnabled() || tileStoreWidget->selectedIndex() != -1) {
+        return;
+    }
+    const QPoint gridPos = mouseGridPos();
+    if (gridPos.x() == -1 || cellAt(gridPos.x(), gridPos.y()) != CELL_EMPTY) {
+        return;
+    }
+    const BestFitMap::Fit fit = bestFits.fit(viewOrigin + gridPos);
+    if (fit.index != -1 && fit.score >= TileStore::QUALITY_THRESHOLD) {
+        placeTile(gridPos.x(), gridPos.y(), fit.index);
+        selectedPos.setX(-1);
+        updateRecommendations();    // Effectively clears them
+    }
+}
+
+void ScreenLabel::paintEvent(QPaintEvent *event)
 {
+    QElapsedTimer frameTimer;
+    frameTimer.start();
     QPainter painter(this);
     painter.setBackgroundMode(Qt::OpaqueMode);
-    const int tileSize = tileStore->tileSize;
-    for (int row = 0; row < numRows; ++row) {
-        for (int col = 0; col < numCols; ++col) {
-            const int xPos = MARGIN + col*tileSize;
-            const int yPos = MARGIN + row*tileSize;
-            const int tileIndex = screenTileRows.at(row).at(col);
-            switch (tileIndex) {
-                case CELL_LOCKED:
-                case CELL_EMPTY:
-                {
-                    if (col == selectedPos.x() && row == selectedPos.y()) {
-                        // Tile is selected for recommendations
-                        if (recommendationIndex == -1) {
-                            painter.fillRect(xPos, yPos, tileSize, tileSize, CELL_SELECTED);
-                        } else {
-                            painter.drawImage(xPos, yPos, tileStore->getTile(recommendationIndex).getImage());
-                        }
-                    } else {
-                        // Display match value
-                        double matchValue = matchRows.at(row).at(col);
-                        if (matchValue >= TileStore::QUALITY_THRESHOLD) {
-                            QColor matchCol;
-                            // If unlikely matches are hidden, expand color range
-                            matchCol.setRed(MAX_MATCH.red()*matchValue);
-                            matchCol.setGreen(MAX_MATCH.green()*matchValue);
-                            matchCol.setBlue(MAX_MATCH.blue()*matchValue);
-                            painter.fillRect(xPos, yPos, tileSize, tileSize, matchCol);
-                        } else {
-                            painter.fillRect(xPos, yPos, tileSize, tileSize, COL_BACK);
-                        }
-                        painter.setPen(COL_GRID);
-                        painter.drawRect(xPos, yPos, tileSize, tileSize);
-                    }
+    const int cellSize = zoomedCellSize();
+    // Placed tiles and empty cells come from the composite
+    const QRect exposed = event->rect();
+    const QRect canvasTarget = exposed.intersected(QRect(MARGIN, MARGIN, numCols*cellSize + 1, numRows*cellSize + 1));
+    if (!canvasTarget.isEmpty()) {
+        painter.drawPixmap(canvasTarget, canvas, canvasTarget.translated(canvasOffset() - QPoint(MARGIN, MARGIN)));
+    }
+    // Overlays only for cells intersecting the exposed region
+    int numCells = 0;
+    const int firstCol = std::max(0, (exposed.left() - MARGIN)/std::max(cellSize, 1));
+    const int lastCol = std::min(numCols - 1, (exposed.right() - MARGIN)/std::max(cellSize, 1));
+    const int firstRow = std::max(0, (exposed.top() - MARGIN)/std::max(cellSize, 1));
+    const int lastRow = std::min(numRows - 1, (exposed.bottom() - MARGIN)/std::max(cellSize, 1));
+    // Match heatmap of the selected store tile
+    if (hasMatchOverlay && cellSize > 0) {
+        for (int row = firstRow; row <= lastRow; ++row) {
+            for (int col = firstCol; col <= lastCol; ++col) {
+                const double matchValue = matchValues.at(matchIndex(col, row));
+                if (matchValue < TileStore::QUALITY_THRESHOLD || cellAt(col, row) >= 0) {
+                    continue;
+                }
+                numCells++;
+                QColor matchCol;
+                // If unlikely matches are hidden, expand color range
+                matchCol.setRed(MAX_MATCH.red()*matchValue);
+                matchCol.setGreen(MAX_MATCH.green()*matchValue);
+                matchCol.setBlue(MAX_MATCH.blue()*matchValue);
+                // Keep the grid lines of the composite
+                painter.fillRect(MARGIN + col*cellSize + 1, MARGIN + row*cellSize + 1, cellSize - 1, cellSize - 1, matchCol);
+            }
+        }
+    } else if (bestFits.isEnabled() && cellSize > 0) {
+        // Faded preview of the best fitting tile of each frontier cell
+        painter.setOpacity(BEST_FIT_OPACITY);
+        for (int row = firstRow; row <= lastRow; ++row) {
+            for (int col = firstCol; col <= lastCol; ++col) {
+                if (cellAt(col, row) >= 0) {
+                    continue;
                 }
-                break;
-            default:
-                painter.drawImage(xPos, yPos, tileStore->getTile(tileIndex).getImage());
-                break;
+                const BestFitMap::Fit fit = bestFits.fit(viewOrigin + QPoint(col, row));
+                if (fit.index == -1 || fit.index >= tileStore->size() || fit.score < TileStore::QUALITY_THRESHOLD) {
+                    continue;
+                }
+                numCells++;
+                tileStore->drawTile(painter, QRect(MARGIN + col*cellSize + 1, MARGIN + row*cellSize + 1, cellSize - 1, cellSize - 1), fit.index);
             }
         }
+        painter.setOpacity(1.0);
+    }
+
+    // Tile is selected for recommendations
+    if (selectedPos.x() != -1 && cellAt(selectedPos.x(), selectedPos.y()) < 0) {
+        const QRect target(MARGIN + selectedPos.x()*cellSize, MARGIN + selectedPos.y()*cellSize, cellSize, cellSize);
+        if (recommendationIndex == -1) {
+            painter.fillRect(target, CELL_SELECTED);
+        } else {
+            tileStore->drawTile(painter, target, recommendationIndex);
+        }
     }
 
     // Hovering tile
     QPoint gridPos = mouseGridPos();
     if (gridPos.x() != -1 && tileStoreWidget->selectedIndex() != -1) {
-        Tile tile = tileStore->getTile(tileStoreWidget->selectedIndex());
-        painter.drawImage(MARGIN + gridPos.x()*tileSize, MARGIN + gridPos.y()*tileSize, tile.getImage());
+        const QRect target(MARGIN + gridPos.x()*cellSize, MARGIN + gridPos.y()*cellSize, cellSize, cellSize);
+        tileStore->drawTile(painter, target, tileStoreWidget->selectedIndex());
+    }
+
+    // Frame statistics
+    lastFrameTime = frameTimer.nsecsElapsed();
+    totalFrameTime += lastFrameTime;
+    numFrames++;
+    totalCellsPainted += numCells;
+}
+
+void ScreenLabel::rebuildCanvas()
+{
+    const int cellSize = zoomedCellSize();
+    canvas = QPixmap(backing.width()*cellSize + 1, backing.height()*cellSize + 1);
+    canvas.fill(COL_BACK);
+    QPainter painter(&canvas);
+    for (int row = backing.top(); row <= backing.bottom(); ++row) {
+        for (int col = backing.left(); col <= backing.right(); ++col) {
+            paintCanvasCell(painter, col - viewOrigin.x(), row - viewOrigin.y());
+        }
+    }
+}
+
+QPoint ScreenLabel::canvasOffset() const
+{
+    return (viewOrigin - backing.topLeft())*zoomedCellSize();
+}
+
+int ScreenLabel::matchIndex(int col, int row) const
+{
+    return (viewOrigin.y() + row - backing.top())*backing.width() + viewOrigin.x() + col - backing.left();
+}
+
+void ScreenLabel::patchCanvas(int col, int row)
+{
+    QPainter painter(&canvas);
+    paintCanvasCell(painter, col, row);
+    // Grid lines of empty cells overlap the right and bottom neighbours
+    if (col + 1 < numCols && cellAt(col + 1, row) >= 0) {
+        paintCanvasCell(painter, col + 1, row);
+    }
+    if (row + 1 < numRows && cellAt(col, row + 1) >= 0) {
+        paintCanvasCell(painter, col, row + 1);
+    }
+}
+
+void ScreenLabel::paintCanvasCell(QPainter &painter, int col, int row)
+{
+    const int cellSize = zoomedCellSize();
+    const QPoint offset = canvasOffset();
+    const int xPos = offset.x() + col*cellSize;
+    const int yPos = offset.y() + row*cellSize;
+    const int tileIndex = cellAt(col, row);
+    if (tileIndex >= 0) {
+        // Screens may still refer to a previous store while a new one is set up
+        if (tileIndex < tileStore->size()) {
+            tileStore->drawTile(painter, QRect(xPos, yPos, cellSize, cellSize), tileIndex);
+        }
+    } else {
+        painter.fillRect(xPos, yPos, cellSize, cellSize, COL_BACK);
+        painter.setPen(COL_GRID);
+        painter.drawRect(xPos, yPos, cellSize, cellSize);
+    }
+}
+
+void ScreenLabel::growScreen(int shiftCols, int shiftRows)
+{
+    const int cellSize = zoomedCellSize();
+    curScreenWidth = cellSize * numCols + 2*MARGIN;
+    curScreenHeight = cellSize * numRows + 2*MARGIN;
+    resize(curScreenWidth, curScreenHeight);
+    const QRect view(viewOrigin, QSize(numCols, numRows));
+    if (!backing.contains(view)) {
+        // Add spare cells proportional to the view on the side that ran out,
+        // so moving the composite and match values is amortized
+        QRect grown = backing;
+        const int spareCols = std::max(numCols/2, MIN_SPARE_CELLS);
+        const int spareRows = std::max(numRows/2, MIN_SPARE_CELLS);
+        if (view.left() < grown.left()) {
+            grown.setLeft(view.left() - spareCols);
+        }
+        if (view.right() > grown.right()) {
+            grown.setRight(view.right() + spareCols);
+        }
+        if (view.top() < grown.top()) {
+            grown.setTop(view.top() - spareRows);
+        }
+        if (view.bottom() > grown.bottom()) {
+            grown.setBottom(view.bottom() + spareRows);
+        }
+        const QRect old = backing;
+        backing = grown;
+        setPixmap(QPixmap::fromImage(QImage(curScreenWidth, curScreenHeight, QImage::Format_ARGB32)));
+        // Move the existing composite and only paint the new cells
+        QPixmap grownCanvas(grown.width()*cellSize + 1, grown.height()*cellSize + 1);
+        grownCanvas.fill(COL_BACK);
+        QPainter painter(&grownCanvas);
+        painter.drawPixmap((old.topLeft() - grown.topLeft())*cellSize, canvas);
+        canvas = grownCanvas;
+        for (int row = grown.top(); row <= grown.bottom(); ++row) {
+            for (int col = grown.left(); col <= grown.right(); ++col) {
+                if (!old.contains(col, row)) {
+                    paintCanvasCell(painter, col - viewOrigin.x(), row - viewOrigin.y());
+                }
+            }
+        }
+        painter.end();
+        // Keep match values of the old cells, new cells are empty
+        QVector<double> grownValues(grown.width()*grown.height(), MATCH_EMPTY);
+        if (matchValues.size() == old.width()*old.height()) {
+            for (int row = 0; row < old.height(); ++row) {
+                const int target = (old.top() - grown.top() + row)*grown.width() + old.left() - grown.left();
+                std::copy(matchValues.constBegin() + row*old.width(), matchValues.constBegin() + (row + 1)*old.width(),
+                          grownValues.begin() + target);
+            }
+        }
+        matchValues = grownValues;
+    }
+    if (selectedPos.x() != -1) {
+        selectedPos += QPoint(shiftCols, shiftRows);
+    }
+    // Scroll along, so the visible part of the grid stays in place
+    QScrollArea *area = scrollArea();
+    if ((shiftCols > 0 || shiftRows > 0) && area != NULL) {
+        QScrollBar *hBar = area->horizontalScrollBar();
+        QScrollBar *vBar = area->verticalScrollBar();
+        hBar->setValue(hBar->value() + shiftCols*cellSize);
+        vBar->setValue(vBar->value() + shiftRows*cellSize);
+    }
+    update();
+}
+
+QRect ScreenLabel::cellRect(QPoint gridPos)
+{
+    const int cellSize = zoomedCellSize();
+    // Include the right and bottom grid lines
+    return QRect(MARGIN + gridPos.x()*cellSize, MARGIN + gridPos.y()*cellSize, cellSize + 1, cellSize + 1);
+}
+
+void ScreenLabel::updateCell(QPoint gridPos)
+{
+    if (gridPos.x() >= 0 && gridPos.y() >= 0) {
+        update(cellRect(gridPos));
+    }
+}
+
+int ScreenLabel::zoomedCellSize() const
+{
+    if (tileStore->tileSize <= 0) {
+        return 0;
+    }
+    return std::max(1, tileStore->tileSize >> zoomLevel);
+}
+
+QScrollArea *ScreenLabel::scrollArea()
+{
+    for (QWidget *w = parentWidget(); w != NULL; w = w->parentWidget()) {
+        QScrollArea *area = qobject_cast<QScrollArea *>(w);
+        if (area != NULL) {
+            return area;
+        }
+    }
+    return NULL;
+}
+
+int ScreenLabel::getZoomLevel() const
+{
+    return zoomLevel;
+}
+
+void ScreenLabel::setZoomLevel(int level)
+{
+    level = std::max(0, std::min(level, MAX_ZOOM_LEVEL));
+    if (level == zoomLevel) {
+        return;
+    }
+    // Keep the point under the mouse, or the center of the view, in place
+    QScrollArea *area = scrollArea();
+    QPoint anchor;
+    if (mousePos.x() != -1 && rect().contains(mousePos)) {
+        anchor = mousePos;
+    } else if (area != NULL) {
+        anchor = mapFrom(area->viewport(), area->viewport()->rect().center());
+    }
+    const QPoint anchorInView = (area != NULL) ? mapTo(area->viewport(), anchor) : QPoint();
+    const QPointF anchorInGrid = QPointF(anchor - QPoint(MARGIN, MARGIN))/std::max(zoomedCellSize(), 1);
+
+    zoomLevel = level;
+    const int cellSize = zoomedCellSize();
+    curScreenWidth = cellSize * numCols + 2*MARGIN;
+    curScreenHeight = cellSize * numRows + 2*MARGIN;
+    resize(curScreenWidth, curScreenHeight);
+    setPixmap(QPixmap::fromImage(QImage(curScreenWidth, curScreenHeight, QImage::Format_ARGB32)));
+    rebuildCanvas();
+
+    if (area != NULL) {
+        const QPointF newAnchor = anchorInGrid*cellSize + QPointF(MARGIN, MARGIN);
+        area->horizontalScrollBar()->setValue(int(newAnchor.x()) - anchorInView.x());
+        area->verticalScrollBar()->setValue(int(newAnchor.y()) - anchorInView.y());
+    }
+    mousePos.setX(-1);
+    update();
+    emit zoomLevelChanged(zoomLevel);
+}
+
+void ScreenLabel::applyChanges(const TileChanges &changes)
+{
+    // New tiles may be better candidates, hidden and removed tiles are not recommended
+    bool recommendationsStale = changes.allTiles || changes.firstInserted != -1
+            || !changes.removed.isEmpty() || !changes.visibility.isEmpty();
+    const int selectedIndex = tileStoreWidget->selectedIndex();
+    Tile selectedTile;
+    if (hasMatchOverlay && selectedIndex != -1) {
+        selectedTile = tileStore->getTile(selectedIndex);
+    }
+    const QPoint neighbours[] = {QPoint(0, 0), QPoint(-1, 0), QPoint(1, 0), QPoint(0, -1), QPoint(0, 1)};
+    foreach (QPoint cell, changes.cells) {
+        const QPoint viewCell = cell - viewOrigin;
+        if (selectedPos.x() != -1 && (viewCell - selectedPos).manhattanLength() <= 1) {
+            recommendationsStale = true;
+        }
+        if (selectedTile.isNull()) {
+            continue;
+        }
+        // Only the cell and its neighbours have a different match value now
+        for (const QPoint &offset : neighbours) {
+            const QPoint p = viewCell + offset;
+            if (p.x() >= 0 && p.x() < numCols && p.y() >= 0 && p.y() < numRows) {
+                matchValues[matchIndex(p.x(), p.y())] = calcMatchValue(selectedTile, selectedIndex, p.x(), p.y(), g_scorers[Heatmap]);
+                updateCell(p);
+            }
+        }
+    }
+    if (recommendationsStale) {
+        updateRecommendations();
+    }
+}
+
+void ScreenLabel::bestFitsChanged(const QVector<QPoint> &cells)
+{
+    foreach (QPoint cell, cells) {
+        updateCell(cell - viewOrigin);
+    }
+}
+
+void ScreenLabel::mipmapsReady()
+{
+    // Replace tiles that have been scaled on the fly
+    if (zoomLevel > 0) {
+        rebuildCanvas();
+        update();
     }
 }
 
-double ScreenLabel::calcMatchValue(Tile &tile, const int index, const int col, const int row, Tile::Filter filter) {
+void ScreenLabel::wheelEvent(QWheelEvent *event)
+{
+    if (event->modifiers() & Qt::ControlModifier) {
+        mousePos = event->pos();
+        if (event->angleDelta().y() > 0) {
+            setZoomLevel(zoomLevel - 1);
+        } else if (event->angleDelta().y() < 0) {
+            setZoomLevel(zoomLevel + 1);
+        }
+        event->accept();
+    } else {
+        // Let the scroll area scroll
+        event->ignore();
+    }
+}
+
+QString ScreenLabel::paintReport()
+{
+    const double avgTime = (numFrames > 0) ? double(totalFrameTime)/numFrames/1000000.0 : 0.0;
+    const double avgCells = (numFrames > 0) ? double(totalCellsPainted)/numFrames : 0.0;
+    return QString("Screen painting: ") + QString::number(numFrames) + " frames, "
+            + QString::number(avgTime, 'f', 2) + " ms average, "
+            + QString::number(lastFrameTime/1000000.0, 'f', 2) + " ms last frame\n"
+            + "Overlay cells painted per frame: " + QString::number(avgCells, 'f', 1)
+            + " of " + QString::number(numRows*numCols);
+}
+
+double ScreenLabel::calcMatchValue(Tile &tile, const int index, const int col, const int row, Tile::Scorer scorer) {
     double matchValue = 0.0;
     int numNeighbours = 0;
-    matchNeighbour(tile, index, col - 1, row, Tile::Edge::Left, filter, &numNeighbours, &matchValue);
-    matchNeighbour(tile, index, col + 1, row, Tile::Edge::Right, filter, &numNeighbours, &matchValue);
-    matchNeighbour(tile, index, col, row - 1, Tile::Edge::Top, filter, &numNeighbours, &matchValue);
-    matchNeighbour(tile, index, col, row + 1, Tile::Edge::Bottom, filter, &numNeighbours, &matchValue);
+    matchNeighbour(tile, index, col - 1, row, Tile::Edge::Left, scorer, &numNeighbours, &matchValue);
+    matchNeighbour(tile, index, col + 1, row, Tile::Edge::Right, scorer, &numNeighbours, &matchValue);
+    matchNeighbour(tile, index, col, row - 1, Tile::Edge::Top, scorer, &numNeighbours, &matchValue);
+    matchNeighbour(tile, index, col, row + 1, Tile::Edge::Bottom, scorer, &numNeighbours, &matchValue);
     if (numNeighbours > 0) {
         matchValue /= numNeighbours;
     } else {
@@ -194,33 +536,111 @@ void ScreenLabel::updateMatchValues()
 {
     const int selectedIndex = tileStoreWidget->selectedIndex();
     if (selectedIndex != -1) {
+        hasMatchOverlay = true;
         Tile selectedTile = tileStore->getTile(selectedIndex);
         // Compute match values for each screen tile
         for (int row = 0; row < numRows; ++row) {
-            auto matchRow = matchRows.at(row);
             for (int col = 0; col < numCols; ++col) {
-                double matchValue = calcMatchValue(selectedTile, selectedIndex, col, row, curFilter);
-                matchRow.replace(col, matchValue);
+                matchValues[matchIndex(col, row)] = calcMatchValue(selectedTile, selectedIndex, col, row, g_scorers[Heatmap]);
             }
-            matchRows.replace(row, matchRow);
         }
     } else {
         // No tile selected: Clear match values
-        for (int row = 0; row < numRows; ++row) {
-            auto matchRow = matchRows.at(row);
-            matchRow.fill(0, numCols);
-            matchRows.replace(row, matchRow);
-        }
+        hasMatchOverlay = false;
+        matchValues.fill(0);
     }
     selectedPos.setX(-1);
     updateRecommendations();    // Effectively clears them
     update();
 }
 
+QString ScreenLabel::locate(int tileIndex, QVector<Placement> *placements)
+{
+    struct Item {
+        Placement placement;
+        BestFitMap::Neighbour neighbours[BestFitMap::NUM_NEIGHBOURS];
+    };
+    QVector<Item> items;
+    for (auto it = screens.constBegin(); it != screens.constEnd(); ++it) {
+        Screen *s = it.value();
+        if (!s->frontierValid) {
+            s->frontier = BestFitMap::frontier(s->grid);
+            s->frontierValid = true;
+        }
+        foreach (QPoint cell, s->frontier) {
+            Item item;
+            item.placement.screen = it.key();
+            item.placement.cell = cell;
+            item.placement.score = 0.0;
+            BestFitMap::copyNeighbours(s->grid, cell, tileStore, item.neighbours);
+            items.append(item);
+        }
+    }
+    const Tile tile = tileStore->getTile(tileIndex);
+    const QVector<qint32> sourceStarts = tileStore->sourceStarts();
+    const Tile::Scorer scorer = g_scorers[Heatmap];
+    QFutureWatcher<void> watcher;
+    watcher.setFuture(QtConcurrent::map(items, [&](Item &item) {
+        Tile own = tile;
+        item.placement.score = BestFitMap::scoreCell(own, tileIndex, item.neighbours, scorer, sourceStarts);
+    }));
+    if (!MainWindow::runWithProgress("Locating tile...", watcher)) {
+        return "Cancelled";
+    }
+    placements->clear();
+    foreach (const Item &item, items) {
+        if (item.placement.score > 0) {
+            placements->append(item.placement);
+        }
+    }
+    std::sort(placements->begin(), placements->end(), [](const Placement &a, const Placement &b) {
+        return a.score > b.score;
+    });
+    if (placements->size() > MAX_PLACEMENTS) {
+        placements->resize(MAX_PLACEMENTS);
+    }
+    return "";
+}
+
+void ScreenLabel::showPlacement(QPoint cell, int tileIndex)
+{
+    QScrollArea *area = scrollArea();
+    if (area != NULL) {
+        const QPoint center = cellRect(cell - viewOrigin).center();
+        area->ensureVisible(center.x(), center.y(), area->viewport()->width()/2, area->viewport()->height()/2);
+    }
+    tileStoreWidget->selectTile(tileIndex);
+}
+
+int ScreenLabel::selectedStoreIndex()
+{
+    return tileStoreWidget->selectedIndex();
+}
+
+int ScreenLabel::addScreen(const QVector<int> &tiles, const QVector<QPoint> &cells, const QString &notes)
+{
+    Q_ASSERT(tiles.size() == cells.size());
+    int id = 0;
+    while (id < MAX_SCREENS && screens.contains(id)) {
+        ++id;
+    }
+    if (id == MAX_SCREENS) {
+        return -1;
+    }
+    Screen *newScreen = screenFor(id);
+    for (int i = 0; i < tiles.size(); ++i) {
+        newScreen->grid.set(cells.at(i).x(), cells.at(i).y(), tiles.at(i));
+    }
+    newScreen->notes = notes;
+    tileStore->incUseCounts(tiles);
+    modified = true;
+    return id;
+}
+
 void ScreenLabel::recommendationHover(int tileIndex)
 {
     recommendationIndex = tileIndex;
-    update();
+    updateCell(selectedPos);
 }
 
 void ScreenLabel::placeRecommendation(int tileIndex)
@@ -229,7 +649,6 @@ void ScreenLabel::placeRecommendation(int tileIndex)
         placeTile(selectedPos.x(), selectedPos.y(), tileIndex);
         selectedPos.setX(-1);
         updateRecommendations();    // Effectively clears them
-        update();
     }
 }
 
@@ -243,55 +662,109 @@ void ScreenLabel::autoplace()
 {
     double bestMatch = 0.0;
     int bestIndex = -1;
-    int bestCol;
-    int bestRow;
+    int bestTier = 0;
+    QPoint bestCell;
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    QVector<QPoint> frontier;
     for (int row = 1; row < numRows - 1; ++row) {
         for (int col = 1; col < numCols - 1; ++col) {
-            if (screenTileRows.at(row).at(col) == CELL_EMPTY) {
+            if (cellAt(col, row) == CELL_EMPTY) {
                 if (
-                        (screenTileRows.at(row).at(col - 1) >= 0)
-                        || (screenTileRows.at(row).at(col + 1) >= 0)
-                        || (screenTileRows.at(row - 1).at(col) >= 0)
-                        || (screenTileRows.at(row + 1).at(col) >= 0)
+                        (cellAt(col - 1, row) >= 0)
+                        || (cellAt(col + 1, row) >= 0)
+                        || (cellAt(col, row - 1) >= 0)
+                        || (cellAt(col, row + 1) >= 0)
                     ) {
-                    for (int i = 0; i < tileStore->size(); ++i) {
-                        Tile tile = tileStore->getTile(i);
-                        double matchValue = calcMatchValue(tile, i, col, row, curFilter);
-                        if (matchValue > bestMatch && matchValue >= TileStore::QUALITY_THRESHOLD && !tileStore->isHidden(i)) {
-                            bestIndex = i;
-                            bestMatch = matchValue;
-                            bestCol = col;
-                            bestRow = row;
-                        }
-                    }
+                    frontier.append(QPoint(col, row));
+                }
+            }
+        }
+    }
+    // Tiles continuing a neighbour's boundary come first
+    foreach (QPoint cell, frontier) {
+        const QHash<int, int> tiers = continuationTiers(cell.x(), cell.y());
+        for (auto it = tiers.constBegin(); it != tiers.constEnd(); ++it) {
+            const int i = it.key();
+            Tile tile = tileStore->getTile(i);
+            double matchValue = calcMatchValue(tile, i, cell.x(), cell.y(), g_scorers[Autoplace]);
+            if (matchValue >= TileStore::QUALITY_THRESHOLD
+                    && (it.value() > bestTier || (it.value() == bestTier && matchValue > bestMatch))) {
+                bestIndex = i;
+                bestMatch = matchValue;
+                bestTier = it.value();
+                bestCell = cell;
+            }
+        }
+    }
+    // Otherwise score the whole store
+    if (bestIndex == -1) {
+        const QVector<int> allCandidates = tileStore->candidates();
+        foreach (QPoint cell, frontier) {
+            foreach (int i, allCandidates) {
+                Tile tile = tileStore->getTile(i);
+                double matchValue = calcMatchValue(tile, i, cell.x(), cell.y(), g_scorers[Autoplace]);
+                if (matchValue > bestMatch && matchValue >= TileStore::QUALITY_THRESHOLD) {
+                    bestIndex = i;
+                    bestMatch = matchValue;
+                    bestCell = cell;
                 }
             }
         }
     }
     QApplication::restoreOverrideCursor();
     if (bestIndex != -1) {
-        placeTile(bestCol, bestRow, bestIndex);
-        update();
+        placeTile(bestCell.x(), bestCell.y(), bestIndex);
+    }
+}
+
+QHash<int, int> ScreenLabel::continuationTiers(int col, int row)
+{
+    QHash<int, int> tiers;
+    const struct {
+        int col;
+        int row;
+        Tile::Edge edge;
+    } neighbours[] = {
+        {col - 1, row, Tile::Edge::Right},
+        {col + 1, row, Tile::Edge::Left},
+        {col, row - 1, Tile::Edge::Bottom},
+        {col, row + 1, Tile::Edge::Top}
+    };
+    for (const auto &neighbour : neighbours) {
+        const int index = cellAt(neighbour.col, neighbour.row);
+        if (index < 0) {
+            continue;
+        }
+        foreach (int i, tileStore->continuations(index, neighbour.edge, EdgeIndex::Quantized)) {
+            if (tileStore->isCandidate(i)) {
+                tiers[i] = qMax(tiers.value(i), TIER_QUANTIZED);
+            }
+        }
+        foreach (int i, tileStore->continuations(index, neighbour.edge, EdgeIndex::Exact)) {
+            if (tileStore->isCandidate(i)) {
+                tiers[i] = TIER_EXACT;
+            }
+        }
     }
+    return tiers;
 }
 
 bool ScreenLabel::mouseIsInsideScreen()
 {
     const int mX = mousePos.x();
     const int mY = mousePos.y();
-    const int tileSize = tileStore->tileSize;
-    return (tileStore->size() > 0 && mX != -1 &&
-            mX >= MARGIN && mX < MARGIN + numCols*tileSize &&
-            mY >= MARGIN && mY < MARGIN + numRows*tileSize);
+    const int cellSize = zoomedCellSize();
+    return (tileStore->size() > 0 && cellSize > 0 && mX != -1 &&
+            mX >= MARGIN && mX < MARGIN + numCols*cellSize &&
+            mY >= MARGIN && mY < MARGIN + numRows*cellSize);
 }
 
 QPoint ScreenLabel::mouseGridPos()
 {
     if (mouseIsInsideScreen()) {
-        const int tileSize = tileStore->tileSize;
-        const int tileCol = (mousePos.x() - MARGIN)/tileSize;
-        const int tileRow = (mousePos.y() - MARGIN)/tileSize;
+        const int cellSize = zoomedCellSize();
+        const int tileCol = (mousePos.x() - MARGIN)/cellSize;
+        const int tileRow = (mousePos.y() - MARGIN)/cellSize;
         return QPoint(tileCol, tileRow);
     } else {
         return QPoint(-1, -1);
@@ -304,41 +777,40 @@ void ScreenLabel::matchNeighbour(
         const int col,
         const int row,
         Tile::Edge edge,
-        Tile::Filter filter,
+        Tile::Scorer scorer,
         int *numNeighbours,
         double *matchValue)
 {
-    if (col >= 0 && col < numCols && row >= 0 && row < numRows && screenTileRows.at(row).at(col) >= 0) {
+    const int otherIndex = cellAt(col, row);
+    if (otherIndex >= 0) {
         *numNeighbours += 1;
-        const int otherIndex = screenTileRows.at(row).at(col);
-        Tile other = tileStore->getTile(screenTileRows.at(row).at(col));
-        *matchValue += tile.calcEdgeSimilarity(other, filter, edge);
-        // Confidence factors
-        // Tile store distance
-        int storeDistance = std::min(abs(index - otherIndex), HEURISTIC_MAX_STORE_DISTANCE);
-        double distFactor = sqrt(storeDistance*storeDistance)/HEURISTIC_MAX_STORE_DISTANCE;
-        *matchValue *= (1.0 - g_heurStoreDistanceWeight*distFactor);
-        // Number of edge colors
-        const double thisNumColors = double(tile.getNumUniqueEdgeColors(edge, filter) - 1);
-        const double otherNumColors = double(other.getNumUniqueEdgeColors(other.oppositeEdge(edge), filter) - 1);
-        const double numColors = std::min(thisNumColors, otherNumColors);
-        const int numColorsThreshold = tile.size*g_heurColorsThreshold;
-        if (numColors <= numColorsThreshold) {
-            double decreaseFactor = (numColors/numColorsThreshold)*g_heurColorsWeight;
-            *matchValue *= (1.0 - g_heurColorsWeight + decreaseFactor);
-        }
-        // Resized
-        if (tile.isResized && edge == Tile::Edge::Bottom) {
-            *matchValue *= HEURISTIC_RESIZED_FACTOR;
-        }
+        Tile other = tileStore->getTile(otherIndex);
+        scoreNeighbour(tile, other, edge, scorer, tileStore->storeDistance(index, otherIndex), matchValue);
     }
 }
 
-//
-// Helper function for sorting
-//
-bool qpLess(const QPair<double, int> &a, const QPair<double, int> &b) {
-    return a.first > b.first;
+void ScreenLabel::scoreNeighbour(Tile &tile, Tile &other, Tile::Edge edge, Tile::Scorer scorer, int storeDistance, double *matchValue)
+{
+    *matchValue += tile.calcEdgeScore(other, scorer, edge);
+    // Confidence factors
+    // Tile store distance
+    storeDistance = std::min(storeDistance, HEURISTIC_MAX_STORE_DISTANCE);
+    double distFactor = sqrt(storeDistance*storeDistance)/HEURISTIC_MAX_STORE_DISTANCE;
+    *matchValue *= (1.0 - g_heurStoreDistanceWeight*distFactor);
+    // Number of edge colors
+    const Tile::Filter filter = Tile::filterOf(scorer);
+    const double thisNumColors = double(tile.getNumUniqueEdgeColors(edge, filter) - 1);
+    const double otherNumColors = double(other.getNumUniqueEdgeColors(other.oppositeEdge(edge), filter) - 1);
+    const double numColors = std::min(thisNumColors, otherNumColors);
+    const int numColorsThreshold = tile.size*g_heurColorsThreshold;
+    if (numColors <= numColorsThreshold) {
+        double decreaseFactor = (numColors/numColorsThreshold)*g_heurColorsWeight;
+        *matchValue *= (1.0 - g_heurColorsWeight + decreaseFactor);
+    }
+    // Resized
+    if (tile.isResized && edge == Tile::Edge::Bottom) {
+        *matchValue *= HEURISTIC_RESIZED_FACTOR;
+    }
 }
 
 void ScreenLabel::updateRecommendations()
@@ -347,15 +819,16 @@ void ScreenLabel::updateRecommendations()
     if (selectedPos.x() != -1) {
         const int col = selectedPos.x();
         const int row = selectedPos.y();
-        for (int i = 0; i < tileStore->size(); ++i) {
-            Tile tile = tileStore->getTile(i);
-            double matchValue = calcMatchValue(tile, i, col, row, Tile::Filter::Gauss15);
-            if (matchValue > 0 && !tileStore->isHidden(i)) {
-                recommendations.append(QPair<double, int>(matchValue, i));
+        // The list is dropped whenever the cell or its neighbours change
+        recommendations.setCandidates(tileStore->candidates(), continuationTiers(col, row), [this, col, row](int i) {
+            if (i >= tileStore->size()) {
+                return 0.0;
             }
-        }
+            Tile tile = tileStore->getTile(i);
+            return calcMatchValue(tile, i, col, row, g_scorers[Recommendations]);
+        });
     }
-    std::sort(recommendations.begin(), recommendations.end(), qpLess);
+    // Scoring and ranking happen on demand, as far as the list is shown
     emit recommendationsChanged();
 }
 
@@ -363,144 +836,136 @@ void ScreenLabel::useScreen(int index)
 {
     // Screen
     tileStoreWidget->clearSelection();
+    // Release the previous screen if there is nothing to keep
+    if (screen != NULL && index != curScreen && screen->grid.isEmpty() && screen->notes.isEmpty()) {
+        screens.remove(curScreen);
+        delete screen;
+    }
     curScreen = index;
-    screenTileRows = screenStore.at(curScreen);
-    numRows = screenTileRows.size();
-    numCols = screenTileRows.at(0).size();
-    curScreenWidth = tileStore->tileSize * numCols + 2*MARGIN;
-    curScreenHeight =tileStore->tileSize * numRows + 2*MARGIN;
+    screen = screenFor(index);
+    bestFits.setGrid(&screen->grid);
+    const QRect view = viewRect(screen->grid);
+    viewOrigin = view.topLeft();
+    numRows = view.height();
+    numCols = view.width();
+    curScreenWidth = zoomedCellSize() * numCols + 2*MARGIN;
+    curScreenHeight = zoomedCellSize() * numRows + 2*MARGIN;
     resize(curScreenWidth, curScreenHeight);
     setPixmap(QPixmap::fromImage(QImage(curScreenWidth, curScreenHeight, QImage::Format_ARGB32)));
+    initMatchValues();
+    rebuildCanvas();
     // Notes
     QPlainTextEdit *textEdit = notes.findChild<QPlainTextEdit *>("screenNotesEdit");
     Q_ASSERT(textEdit != NULL);
-    textEdit->setPlainText(notesStore.at(curScreen));
+    textEdit->setPlainText(screen->notes);
     // Propagate update
-    initMatchRows();
+    hasMatchOverlay = false;
     selectedPos.setX(-1);
     recommendationIndex = -1;
     updateRecommendations();
     update();
 }
 
-void ScreenLabel::initMatchRows() {
-    matchRows.clear();
-    for (int i = 0; i < numRows; ++i) {
-        QVector<double> rm(numCols, MATCH_EMPTY);
-        matchRows.push_back(rm);
-    }
+void ScreenLabel::initMatchValues() {
+    backing = QRect(viewOrigin, QSize(numCols, numRows));
+    matchValues.fill(MATCH_EMPTY, numCols*numRows);
 }
 
 void ScreenLabel::initScreens()
 {
-    // Init screen store
-    screenStore.clear();
-    for (int s = 0; s < SCREENSTORE_SIZE; ++s) {
-        QVector<QVector<int>> screen;
-        for (int i = 0; i < SCREEN_DEFAULT_HEIGHT; ++i) {
-            QVector<int> row(SCREEN_DEFAULT_WIDTH, CELL_EMPTY);
-            screen.push_back(row);
-        }
-        screenStore.push_back(screen);
-    }
-    // Init notes store
-    for (int i = 0; i < SCREENSTORE_SIZE; ++i) {
-        QString s;
-        notesStore.push_back(s);
-    }
-
     // Clear and init current screen
-    screenTileRows.clear();
+    clearScreens();
+    curScreen = 0;
+    screen = screenFor(0);
+    bestFits.setGrid(&screen->grid);
+    viewOrigin = QPoint(0, 0);
     numRows = SCREEN_DEFAULT_HEIGHT;
     numCols = SCREEN_DEFAULT_WIDTH;
-    curScreenWidth = tileStore->tileSize * SCREEN_DEFAULT_WIDTH + 2*MARGIN;
-    curScreenHeight = tileStore->tileSize * SCREEN_DEFAULT_HEIGHT + 2*MARGIN;
-    // Init tile matrix
-    for (int i = 0; i < SCREEN_DEFAULT_HEIGHT; ++i) {
-        QVector<int> rt(SCREEN_DEFAULT_WIDTH, CELL_EMPTY);
-        screenTileRows.push_back(rt);
-    }
-    initMatchRows();
+    curScreenWidth = zoomedCellSize() * SCREEN_DEFAULT_WIDTH + 2*MARGIN;
+    curScreenHeight = zoomedCellSize() * SCREEN_DEFAULT_HEIGHT + 2*MARGIN;
+    initMatchValues();
+    rebuildCanvas();
     modified = false;
 }
 
-bool ScreenLabel::isEmpty(QVector<QVector<int>> screen)
+int ScreenLabel::cellAt(int col, int row) const
 {
-    for (int row = 0; row < screen.size(); ++row) {
-        auto curRow = screen.at(row);
-        for (int col = 0; col < curRow.size(); ++col) {
-            if (curRow.at(col) >= 0) {
-                return false;
-            }
-        }
+    return screen->grid.at(viewOrigin.x() + col, viewOrigin.y() + row);
+}
+
+void ScreenLabel::setCell(int col, int row, int tileIndex)
+{
+    screen->grid.set(viewOrigin.x() + col, viewOrigin.y() + row, tileIndex);
+    screen->frontierValid = false;
+    emit cellChanged(viewOrigin + QPoint(col, row));
+}
+
+ScreenLabel::Screen *ScreenLabel::screenFor(int id)
+{
+    Screen *result = screens.value(id, NULL);
+    if (result == NULL) {
+        result = new Screen;
+        screens.insert(id, result);
     }
-    return true;
+    return result;
+}
+
+void ScreenLabel::clearScreens()
+{
+    bestFits.setGrid(NULL);
+    qDeleteAll(screens);
+    screens.clear();
+    screen = NULL;
+}
+
+QRect ScreenLabel::viewRect(const ScreenGrid &screen)
+{
+    const QRect defaultRect(0, 0, SCREEN_DEFAULT_WIDTH, SCREEN_DEFAULT_HEIGHT);
+    if (screen.isEmpty()) {
+        return defaultRect;
+    }
+    return screen.bounds().adjusted(-2, -2, 2, 2).united(defaultRect);
 }
 
 void ScreenLabel::placeTile(int x, int y, int tileIndex)
 {
     clearCell(x, y);
-    auto row = screenTileRows.at(y);
-    row.replace(x, tileIndex);
+    setCell(x, y, tileIndex);
     tileStore->incUseCount(tileIndex);
-    screenTileRows.replace(y, row);
     modified = true;
-    // Check if screen has to grow
+    patchCanvas(x, y);
+    updateCell(QPoint(x, y));
+    // Check if the view has to grow; the grid itself is unbounded
     if (x <= 1) {
-        for (int row = 0; row < screenTileRows.size(); ++row) {
-            auto tileRow = screenTileRows.at(row);
-            tileRow.prepend(CELL_EMPTY);
-            screenTileRows.replace(row, tileRow);
-            auto matchRow = matchRows.at(row);
-            matchRow.prepend(0);
-            matchRows.replace(row, matchRow);
-        }
+        viewOrigin.rx()--;
         numCols++;
-        storeCurrentScreen();
-        useScreen(curScreen);
+        growScreen(1, 0);
     } else if (x >= numCols - 2) {
-        for (int row = 0; row < screenTileRows.size(); ++row) {
-            auto tileRow = screenTileRows.at(row);
-            tileRow.append(CELL_EMPTY);
-            screenTileRows.replace(row, tileRow);
-            auto matchRow = matchRows.at(row);
-            matchRow.append(0);
-            matchRows.replace(row, matchRow);
-        }
         numCols++;
-        storeCurrentScreen();
-        useScreen(curScreen);
+        growScreen(0, 0);
     }
     if (y <= 1) {
-        QVector<int> newRow(numCols, CELL_EMPTY);
-        screenTileRows.prepend(newRow);
-        QVector<double> newMatchRow(numCols, 0);
-        matchRows.prepend(newMatchRow);
+        viewOrigin.ry()--;
         numRows++;
-        storeCurrentScreen();
-        useScreen(curScreen);
+        growScreen(0, 1);
     } else if (y >= numRows - 2) {
-        QVector<int> newRow(numCols, CELL_EMPTY);
-        screenTileRows.append(newRow);
-        QVector<double> newMatchRow(numCols, 0);
-        matchRows.append(newMatchRow);
         numRows++;
-        storeCurrentScreen();
-        useScreen(curScreen);
+        growScreen(0, 0);
     }
-    emit availableTilesChanged();
 }
 
 int ScreenLabel::clearCell(int x, int y)
 {
-    auto row = screenTileRows.at(y);
-    int erasedIndex = row.at(x);
+    int erasedIndex = cellAt(x, y);
     if (erasedIndex >= 0) {
         tileStore->decUseCount(erasedIndex);
     }
-    row.replace(x, CELL_EMPTY);
-    screenTileRows.replace(y, row);
+    setCell(x, y, CELL_EMPTY);
     modified = true;
+    if (erasedIndex >= 0) {
+        patchCanvas(x, y);
+        updateCell(QPoint(x, y));
+    }
     return erasedIndex;
 }
 
@@ -509,6 +974,17 @@ NotesDialog *ScreenLabel::getNotesDialog()
     return &notes;
 }
 
+BestFitMap *ScreenLabel::getBestFitMap()
+{
+    return &bestFits;
+}
+
+void ScreenLabel::setBestFitOverlay(bool enabled)
+{
+    bestFits.setEnabled(enabled);
+    update();
+}
+
 bool ScreenLabel::isModified() const
 {
     return modified;
@@ -519,6 +995,11 @@ void ScreenLabel::clearModified()
     modified = false;
 }
 
+void ScreenLabel::setModified()
+{
+    modified = true;
+}
+
 void ScreenLabel::notesWindowStateChanges(int state)
 {
     if (state == Qt::Checked) {
@@ -535,7 +1016,7 @@ void ScreenLabel::notesModified(bool)
     modified = true;
 }
 
-QVector<QPair<double, int>> *ScreenLabel::getRecommendations()
+RecommendationList *ScreenLabel::getRecommendations()
 {
     return &recommendations;
 }
@@ -545,7 +1026,9 @@ QString ScreenLabel::saveCase(QString filename)
     if (!filename.endsWith(".rcs")) {
         filename.append(".rcs");
     }
-    QFile caseFile(filename);
+    // Write to a temporary file first: tile pixels may be paged from the
+    // existing case file while saving
+    QSaveFile caseFile(filename);
     if (!caseFile.open(QIODevice::WriteOnly)) {
         return "Unable to open file for writing!";
     }
@@ -561,6 +1044,10 @@ QString ScreenLabel::saveCase(QString filename)
     if (!result.isEmpty()) {
         return result;
     }
+    if (!caseFile.commit()) {
+        return "Unable to write case file!";
+    }
+    tileStore->rebindPixels(filename);
     modified = false;
     return "";
 }
@@ -582,12 +1069,11 @@ QString ScreenLabel::loadCase(QString filename) {
         return "Case file has been created by a newer version of this program!";
     }
     in.setVersion(QDataStream::Qt_5_9);
-    QString result = tileStore->loadData(in);
+    QString result = tileStore->loadData(in, version);
     if (!result.isEmpty()) {
         return result;
     }
-    bool loadNotes = (version >= 2);
-    result = loadData(in, loadNotes);
+    result = loadData(in, version);
     if (!result.isEmpty()) {
         return result;
     }
@@ -597,43 +1083,62 @@ QString ScreenLabel::loadCase(QString filename) {
 
 QString ScreenLabel::saveData(QDataStream &out)
 {
-    // Construct vector of screens that actually contain data
-    QVector<QVector<QVector<int>>> toSave;
-    QVector<QString> notesToSave;
-    for (int i = 0; i < screenStore.size(); ++i) {
-        if (!isEmpty(screenStore.at(i))) {
-            toSave.append(screenStore.at(i));
-            notesToSave.append(notesStore.at(i));
+    // Only screens that actually contain data are saved, along with their ids
+    QList<int> toSave;
+    for (auto it = screens.constBegin(); it != screens.constEnd(); ++it) {
+        if (!it.value()->grid.isEmpty() || !it.value()->notes.isEmpty()) {
+            toSave.append(it.key());
         }
     }
-    out << toSave;
-    out << notesToSave;
+    out << (qint32)toSave.size();
+    foreach (int id, toSave) {
+        const Screen *s = screens.value(id);
+        out << (qint32)id;
+        out << s->grid.toDense(viewRect(s->grid));
+        out << s->notes;
+    }
     modified = false;
     return "";
 }
 
-QString ScreenLabel::loadData(QDataStream &in, bool loadNotes)
+QString ScreenLabel::loadData(QDataStream &in, quint32 version)
 {
-    screenStore.clear();
-    in >> screenStore;
-    // Fill up rest of screen store with empty screens
-    while (screenStore.size() < SCREENSTORE_SIZE) {
-        QVector<QVector<int>> screen;
-        for (int i = 0; i < SCREEN_DEFAULT_HEIGHT; ++i) {
-            QVector<int> row(SCREEN_DEFAULT_WIDTH, CELL_EMPTY);
-            screen.push_back(row);
+    clearScreens();
+    if (version >= 3) {
+        qint32 numScreens;
+        in >> numScreens;
+        for (int i = 0; i < numScreens; ++i) {
+            qint32 id;
+            QVector<QVector<int>> dense;
+            QString screenNotes;
+            in >> id >> dense >> screenNotes;
+            if (in.status() != QDataStream::Ok || id < 0 || id >= MAX_SCREENS || screens.contains(id)) {
+                clearScreens();
+                screen = screenFor(0);
+                return "Corrupt screen data!";
+            }
+            Screen *s = screenFor(id);
+            s->grid = ScreenGrid::fromDense(dense);
+            s->notes = screenNotes;
+        }
+    } else {
+        // Older case files store non-empty screens consecutively, notes since version 2
+        QVector<QVector<QVector<int>>> denseScreens;
+        in >> denseScreens;
+        QVector<QString> screenNotes;
+        if (version >= 2) {
+            in >> screenNotes;
+        }
+        for (int i = 0; i < denseScreens.size(); ++i) {
+            Screen *s = screenFor(i);
+            s->grid = ScreenGrid::fromDense(denseScreens.at(i));
+            if (i < screenNotes.size()) {
+                s->notes = screenNotes.at(i);
+            }
         }
-        screenStore.push_back(screen);
-    }
-    notesStore.clear();
-    if (loadNotes) {
-        in >> notesStore;
-    }
-    // Fill up rest of notes store
-    while (notesStore.size() < SCREENSTORE_SIZE) {
-        QString s;
-        notesStore.push_back(s);
     }
+    curScreen = 0;
+    screen = screenFor(0);
     modified = false;
     return "";
 }
@@ -642,52 +1147,24 @@ QString ScreenLabel::exportScreens(QString prefix)
 {
     storeCurrentScreen();
     // Iterate over screens and export used ones
+    ScreenExporter exporter(tileStore);
     int exportNum = 0;
     QString notesString;
-    for (int s = 0; s < screenStore.size(); ++s) {
-        if (!isEmpty(screenStore.at(s))) {
-            QVector<QVector<int>> screen = screenStore.at(s);
-            // Determine image boundaries
-            int top = 999999;
-            int right = -1;
-            int bottom = -1;
-            int left = 999999;
-            const int width = screen.at(0).size();
-            const int height = screen.size();
-            for (int row = 0; row < height; ++row) {
-                for (int col = 0; col < width; ++col) {
-                    if (screen.at(row).at(col) >= 0) {
-                        top = std::min(row, top);
-                        right = std::max(col, right);
-                        bottom = std::max(row, bottom);
-                        left = std::min(col, left);
-                    }
-                }
-            }
-            // Create image
-            QImage image((right - left + 1)*tileStore->tileSize, (bottom - top + 1)*tileStore->tileSize, QImage::Format_ARGB32);
-            image.fill(Qt::GlobalColor::transparent);
-            QPainter painter;
-            painter.begin(&image);
-            for (int row = top; row <= bottom; ++row) {
-                for (int col = left; col <= right; ++col) {
-                    const int tileIndex = screen.at(row).at(col);
-                    if (tileIndex >= 0) {
-                        painter.drawImage((col - left)*tileStore->tileSize, (row - top)*tileStore->tileSize, tileStore->getTile(tileIndex).getImage());
-                    }
-                }
-            }
-            painter.end();
-            QString filename = prefix + "_" + QString("%1").arg(++exportNum, 2, 10, QChar('0')) + ".png";
-            if (!image.save(filename)) {
-                return "Unable to save image!";
-            }
+    for (auto it = screens.constBegin(); it != screens.constEnd(); ++it) {
+        const Screen *s = it.value();
+        if (!s->grid.isEmpty()) {
+            QString filename = prefix + "_" + QString("%1").arg(++exportNum, 2, 10, QChar('0')) + "." + ScreenExporter::g_format;
+            exporter.addScreen(s->grid.toDense(s->grid.bounds()), filename);
             // Add notes, if present
-            if (!notesStore.at(s).isEmpty()) {
-                notesString.append(filename + ":\n" + notesStore.at(s).trimmed() + "\n\n");
+            if (!s->notes.isEmpty()) {
+                notesString.append(filename + ":\n" + s->notes.trimmed() + "\n\n");
             }
         }
     }
+    QString result = exporter.run();
+    if (!result.isEmpty()) {
+        return result;
+    }
     // Write notes textfile
     if (!notesString.isEmpty()) {
         QFile notesFile(prefix + ".txt");
@@ -704,10 +1181,9 @@ QString ScreenLabel::exportScreens(QString prefix)
 
 void ScreenLabel::storeCurrentScreen()
 {
-    screenStore.replace(curScreen, screenTileRows);
     QPlainTextEdit *textEdit = notes.findChild<QPlainTextEdit *>("screenNotesEdit");
     Q_ASSERT(textEdit != NULL);
-    notesStore.replace(curScreen, textEdit->document()->toPlainText());
+    screen->notes = textEdit->document()->toPlainText();
 }
 
 void ScreenLabel::tileStoreChanged()
@@ -25,10 +25,19 @@
 #include <QLabel>
 #include <QMouseEvent>
 #include <QVector>
+#include <QMap>
+#include <QPixmap>
+#include <QPainter>
+#include <QScrollArea>
+#include <QWheelEvent>
 
 #include "tilestore.h"
 #include "tilestorewidget.h"
 #include "notesdialog.h"
+#include "screengrid.h"
+#include "recommendationlist.h"
+#include "updatescheduler.h"
+#include "bestfitmap.h"
 
 class ScreenLabel : public QLabel
 {
@@ -36,14 +45,14 @@ class ScreenLabel : public QLabel
 
 public:
     //
-    // Screen size in tiles
+    // Minimum screen view size in tiles
     //
     static const int SCREEN_DEFAULT_WIDTH;
     static const int SCREEN_DEFAULT_HEIGHT;
     //
-    // Max number of screens, corresponds to max setting in respective spin box
+    // Upper bound for screen ids, corresponds to max setting in respective spin box
     //
-    static const int SCREENSTORE_SIZE;
+    static const int MAX_SCREENS;
     //
     // Cell states
     //
@@ -54,6 +63,19 @@ public:
     //
     static const double MATCH_EMPTY;
     //
+    // Minimum number of cells added to the composite when the view outgrows it
+    //
+    static const int MIN_SPARE_CELLS;
+    //
+    // Zoom level n shows tiles at 1/2^n of their size
+    //
+    static const int MAX_ZOOM_LEVEL;
+    //
+    // Recommendation tiers of tiles continuing a neighbour's boundary
+    //
+    static const int TIER_QUANTIZED;
+    static const int TIER_EXACT;
+    //
     // Greater distances are reduced to this value for heuristic
     //
     static const int HEURISTIC_MAX_STORE_DISTANCE;
@@ -67,8 +89,30 @@ public:
     //
     static double g_heurColorsThreshold;
     static double g_heurColorsWeight;
+    //
+    // Opacity of best fit previews in empty cells
+    //
+    static const double BEST_FIT_OPACITY;
+    //
+    // Edge scorer used for each operation
+    //
+    enum Operation {Heatmap, Recommendations, Autoplace, NUM_OPERATIONS};
+    static Tile::Scorer g_scorers[NUM_OPERATIONS];
+    //
+    // Possible place of a tile on a screen, cell in grid coordinates
+    //
+    struct Placement {
+        int screen;
+        QPoint cell;
+        double score;
+    };
+    //
+    // Maximum number of placements returned by locate
+    //
+    static const int MAX_PLACEMENTS;
 
     ScreenLabel(TileStore *tileStore, TileStoreWidget *tileStoreWidget);
+    ~ScreenLabel();
 
     QString saveCase(QString filename);
     QString loadCase(QString filename);
@@ -76,10 +120,10 @@ public:
     // Save and load case data, without magic and version (called by save/laodCase)
     //
     QString saveData(QDataStream &out);
-    QString loadData(QDataStream &in, bool loadNotes);
+    QString loadData(QDataStream &in, quint32 version);
     QString exportScreens(QString prefix);
     //
-    // Transfer current screen and note contents to store
+    // Transfer note contents of current screen to store
     //
     void storeCurrentScreen();
     void placeTile(int x, int y, int tileIndex);
@@ -88,13 +132,51 @@ public:
     //
     bool isModified() const;
     void clearModified();
-    QVector<QPair<double, int> > *getRecommendations();
+    void setModified();
+    RecommendationList *getRecommendations();
     NotesDialog *getNotesDialog();
+    BestFitMap *getBestFitMap();
+    //
+    // Score a tile against the frontier cells of all screens in parallel and
+    // store the best placements, best first. Returns an error message or an
+    // empty string.
+    //
+    QString locate(int tileIndex, QVector<Placement> *placements);
+    //
+    // Scroll a cell of the current screen into view and select the tile in
+    // the store, so its heatmap is shown and a click places it
+    //
+    void showPlacement(QPoint cell, int tileIndex);
+    int selectedStoreIndex();
+    //
+    // Create a screen with the given tiles placed at their cells, using the
+    // lowest free screen id. Returns the id, or -1 if all ids are in use.
+    //
+    int addScreen(const QVector<int> &tiles, const QVector<QPoint> &cells, const QString &notes);
+    void setBestFitOverlay(bool enabled);
+    //
+    // Add the score of a neighbour's edge to *matchValue and apply the
+    // confidence heuristics; thread-safe
+    //
+    static void scoreNeighbour(Tile &tile, Tile &other, Tile::Edge edge, Tile::Scorer scorer, int storeDistance, double *matchValue);
 
     void mouseMoveEvent(QMouseEvent *event) override;
     void leaveEvent(QEvent *) override;
     void mousePressEvent(QMouseEvent *event) override;
-    void paintEvent(QPaintEvent *) override;
+    //
+    // Double click on an empty cell places its best fit
+    //
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+    //
+    // Ctrl + mouse wheel zooms
+    //
+    void wheelEvent(QWheelEvent *event) override;
+    int getZoomLevel() const;
+    //
+    // Frame time statistics of paintEvent
+    //
+    QString paintReport();
 
 
 public slots:
@@ -108,10 +190,21 @@ public slots:
     void screenNumberChanged(int newNumber);
     void autoplace();
     void updateRecommendations();
+    void setZoomLevel(int level);
+    void mipmapsReady();
+    //
+    // Recompute match values and recommendations affected by the changes
+    //
+    void applyChanges(const TileChanges &changes);
+    void bestFitsChanged(const QVector<QPoint> &cells);
 
 signals:
     void recommendationsChanged();
-    void availableTilesChanged();
+    //
+    // A cell of the current screen changed, in grid coordinates
+    //
+    void cellChanged(QPoint cell);
+    void zoomLevelChanged(int level);
 
 private:
     static const int MARGIN = 64;
@@ -124,13 +217,29 @@ private:
     static const QString CASEFILE_MAGIC;
     static const int CASEFILE_VERSION;
 
-    const Tile::Filter curFilter = Tile::Filter::Gauss15;
+    struct Screen {
+        ScreenGrid grid;
+        QString notes;
+        //
+        // Frontier cells for locate, valid until a cell of the screen changes
+        //
+        QVector<QPoint> frontier;
+        bool frontierValid = false;
+    };
+
     QPoint selectedPos{-1, -1};
     bool modified;
     TileStore *tileStore;
     TileStoreWidget * tileStoreWidget;
+    //
+    // The view is the part of the grid shown in the widget: numCols x numRows
+    // cells, with view cell (0, 0) at viewOrigin in grid coordinates. All cell
+    // positions used by the widget are view coordinates.
+    //
+    QPoint viewOrigin;
     int numRows;
     int numCols;
+    int zoomLevel = 0;
     //
     // Complete imagle size in pixels
     //
@@ -141,15 +250,41 @@ private:
     // Current (last) mouse position
     //
     QPoint mousePos;
-    QVector<QVector<int>> screenTileRows;
-    QVector<QVector<double>> matchRows;
+    //
+    // Cells held by the composite and match values, in grid coordinates.
+    // Always contains the view and grows geometrically, with spare cells
+    // around it, so growing the view by a row or column is cheap.
+    //
+    QRect backing;
+    //
+    // Match values of the backing cells, row by row
+    //
+    QVector<double> matchValues;
+    bool hasMatchOverlay = false;
+    //
+    // Composite of the current screen's placed tiles and empty cells at the
+    // current zoom level, without overlays; covers the backing cells
+    //
+    QPixmap canvas;
     int curScreen;
-    QVector<QVector<QVector<int>>> screenStore;
-    QVector<QString> notesStore;
-    QVector<QPair<double, int>> recommendations;
+    //
+    // Screens by id. Screens other than the current one are only allocated
+    // while they contain tiles or notes.
+    //
+    QMap<int, Screen *> screens;
+    Screen *screen;
+    RecommendationList recommendations;
+    BestFitMap bestFits;
     NotesDialog notes;
     QRect notesGeometry;
     //
+    // Paint statistics, times in nanoseconds
+    //
+    qint64 lastFrameTime = 0;
+    qint64 totalFrameTime = 0;
+    qint64 numFrames = 0;
+    qint64 totalCellsPainted = 0;
+    //
     // Depending on numCols, numRows, tileSize and MARGIN
     //
     bool mouseIsInsideScreen();
@@ -158,6 +293,16 @@ private:
     //
     QPoint mouseGridPos();
     //
+    // Widget area of a cell including its grid lines; updateCell ignores (-1, -1)
+    //
+    QRect cellRect(QPoint gridPos);
+    void updateCell(QPoint gridPos);
+    //
+    // Displayed size of a cell at the current zoom level
+    //
+    int zoomedCellSize() const;
+    QScrollArea *scrollArea();
+    //
     // Return overall score for a given tile and cell; look at all four neighbours
     //
     double calcMatchValue(
@@ -165,9 +310,14 @@ private:
             const int index,
             const int col,
             const int row,
-            Tile::Filter filter
+            Tile::Scorer scorer
             );
     //
+    // Tiles continuing the boundary of a neighbour of the cell, with the tier
+    // of the best continuation
+    //
+    QHash<int, int> continuationTiers(int col, int row);
+    //
     // Store score into *matchValue and update *numNeighbours
     //
     void matchNeighbour(
@@ -176,20 +326,50 @@ private:
             const int col,
             const int row,
             Tile::Edge edge,
-            Tile::Filter filter,
+            Tile::Scorer scorer,
             int *numNeighbours,
             double *matchValue
             );
     //
-    // Switch to screen, i.e. put screen and notes from store into current
+    // Switch to screen, i.e. make it current and show its notes
     //
     void useScreen(int index);
-    bool isEmpty(QVector<QVector<int>> screen);
+    //
+    // Adapt widget, composite and match values after numCols/numRows have
+    // grown; the shift is the number of columns/rows added at the top left
+    //
+    void growScreen(int shiftCols, int shiftRows);
+    void rebuildCanvas();
+    //
+    // Position of view cell (0, 0) in the composite, in pixels
+    //
+    QPoint canvasOffset() const;
+    int matchIndex(int col, int row) const;
+    //
+    // Repaint a cell of the composite after its content changed
+    //
+    void patchCanvas(int col, int row);
+    void paintCanvasCell(QPainter &painter, int col, int row);
+    int cellAt(int col, int row) const;
+    void setCell(int col, int row, int tileIndex);
+    //
+    // View rectangle of a screen in grid coordinates: its tiles plus two empty
+    // cells on each side, and at least the default screen size
+    //
+    static QRect viewRect(const ScreenGrid &screen);
+    //
+    // Return screen with the given id, allocating it if necessary
+    //
+    Screen *screenFor(int id);
+    void clearScreens();
     //
     // Returns deleted cell content
     //
     int clearCell(int x, int y);
-    void initMatchRows();
+    //
+    // Reset the backing cells to the view and clear the match values
+    //
+    void initMatchValues();
 };
 
 #endif // SCREENLABEL_H
@@ -22,9 +22,17 @@
 #include <math.h>
 #include <stdexcept>
 #include <QSet>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "tile.h"
 
+Tile::EdgeMetric Tile::g_edgeMetric = Tile::Euclidean;
+const double Tile::GRADIENT_SCALE = 6.0;
+
 const int Tile::Gauss1Kernel[5][5] = {
     {0, 0, 0, 0, 0},
     {0, 0, 0, 0, 0},
@@ -47,7 +55,8 @@ const int Tile::Gauss15Kernel[5][5] = {
     {1, 4, 6, 4, 1}
 };
 
-Tile::Tile(QString filename)
+Tile::Tile(QString filename, Tile::EdgeMetric metric)
+    : edgeMetric(metric)
 {
     image.load(filename);
     if (!image.isNull()) {
@@ -61,25 +70,30 @@ Tile::Tile(QString filename)
             }
             size = image.width();
             precalcEdgeColors();
+            precalcGradients();
+            classify();
         }
     }
 }
 
-Tile::Tile(QImage image, bool isResized, bool isDuplicate)
+Tile::Tile(QImage image, bool isResized, bool isDuplicate, Tile::EdgeMetric metric)
+    : edgeMetric(metric)
 {
     this->image = image;
     size = image.width();
     this->isResized = isResized;
     this->isDuplicate = isDuplicate;
     precalcEdgeColors();
+    precalcGradients();
+    classify();
 }
 
 bool Tile::isNull() const
 {
-    return image.isNull();
+    return size == 0;
 }
 
-Tile::Edge Tile::oppositeEdge(Tile::Edge e)
+Tile::Edge Tile::oppositeEdge(Tile::Edge e) const
 {
     switch (e) {
         case Top:
@@ -99,13 +113,32 @@ QImage Tile::getImage() const
     return image;
 }
 
+void Tile::dropImage()
+{
+    image = QImage();
+}
+
 QVector<Tile::AvgColor> Tile::getEdgeColors(Edge edge, Tile::Filter filter)
 {
+    if (edgeMetric == Sad) {
+        QVector<AvgColor> colors(size);
+        const uchar *packed = packedEdge(edge, filter);
+        const int stride = packedStride();
+        for (int i = 0; i < size; ++i) {
+            colors[i] = AvgColor(packed[i], packed[stride + i], packed[2*stride + i]);
+        }
+        return colors;
+    }
     return edgeColorsByFilter.value(filter).value(edge);
 }
 
 double Tile::calcEdgeSimilarity(Tile &other, Tile::Filter filter, Tile::Edge edge)
 {
+    if (edgeMetric == Sad && other.edgeMetric == Sad && size == other.size) {
+        const quint32 sad = sumOfAbsoluteDifferences(
+                    packedEdge(edge, filter), other.packedEdge(oppositeEdge(edge), filter), 3*packedStride());
+        return 1.0 - (double(sad) / (255*3) / size);
+    }
     double error = 0.0;
     QVector<AvgColor> ownColors = getEdgeColors(edge, filter);
     QVector<AvgColor> otherColors = other.getEdgeColors(oppositeEdge(edge), filter);
@@ -126,6 +159,302 @@ int Tile::getNumUniqueEdgeColors(Tile::Edge edge, Tile::Filter filter)
     return numUniqueEdgeColors.value(filter).value(edge);
 }
 
+double Tile::calcGradientCompatibility(Tile &other, Tile::Edge edge)
+{
+    if (size != other.size || boundaryPixels.isEmpty() || other.boundaryPixels.isEmpty()) {
+        return 0.0;
+    }
+    const Edge otherEdge = oppositeEdge(edge);
+    const uchar *own = boundaryLine(edge);
+    const uchar *others = other.boundaryLine(otherEdge);
+    // Symmetric: predict from both sides
+    const double sum = mahalanobisSum(own, others, gradientStats[edge], size)
+            + mahalanobisSum(others, own, other.gradientStats[otherEdge], size);
+    const double perSample = sum/(2*size);
+    return 1.0/(1.0 + perSample/GRADIENT_SCALE);
+}
+
+double Tile::calcEdgeScore(Tile &other, Tile::Scorer scorer, Tile::Edge edge)
+{
+    if (scorer == Gradients) {
+        return calcGradientCompatibility(other, edge);
+    }
+    return calcEdgeSimilarity(other, filterOf(scorer), edge);
+}
+
+quint32 Tile::boundaryHash(Tile::Edge edge, int shift) const
+{
+    const uchar *line = boundaryLine(edge);
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < 3*size; ++i) {
+        hash = (hash ^ quint32(line[i] >> shift))*16777619u;
+    }
+    return hash;
+}
+
+bool Tile::continuesInto(const Tile &other, Tile::Edge edge, int shift) const
+{
+    if (size != other.size || boundaryPixels.isEmpty() || other.boundaryPixels.isEmpty()) {
+        return false;
+    }
+    const uchar *own = boundaryLine(edge);
+    const uchar *others = other.boundaryLine(oppositeEdge(edge));
+    for (int i = 0; i < 3*size; ++i) {
+        if ((own[i] >> shift) != (others[i] >> shift)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Tile::isUniformBoundary(Tile::Edge edge, int shift) const
+{
+    if (boundaryPixels.isEmpty()) {
+        return false;
+    }
+    const uchar *line = boundaryLine(edge);
+    for (int channel = 0; channel < 3; ++channel) {
+        const uchar *values = line + channel*size;
+        for (int i = 1; i < size; ++i) {
+            if ((values[i] >> shift) != (values[0] >> shift)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+Tile::Filter Tile::filterOf(Tile::Scorer scorer)
+{
+    switch (scorer) {
+    case ColorsGauss6:
+        return Filter::Gauss6;
+    case ColorsGauss15:
+        return Filter::Gauss15;
+    default:
+        // The gradient scorer works on unfiltered pixels
+        return Filter::Gauss1;
+    }
+}
+
+Tile::EdgeMetric Tile::getEdgeMetric() const
+{
+    return edgeMetric;
+}
+
+int Tile::featureBytes() const
+{
+    const int gradientBytes = boundaryPixels.size() + int(sizeof(gradientStats));
+    if (edgeMetric == Sad) {
+        return packedEdges.size() + gradientBytes;
+    }
+    return NUM_FILTERS*4*size*int(sizeof(AvgColor)) + gradientBytes;
+}
+
+int Tile::packedStride() const
+{
+    return (size + 15) & ~15;
+}
+
+const uchar *Tile::packedEdge(Tile::Edge edge, Tile::Filter filter) const
+{
+    const int offset = (int(filter)*4 + int(edge))*3*packedStride();
+    return reinterpret_cast<const uchar *>(packedEdges.constData()) + offset;
+}
+
+void Tile::packEdgeColors(Tile::Edge edge, Tile::Filter filter, const QVector<AvgColor> &colors)
+{
+    const int stride = packedStride();
+    uchar *packed = reinterpret_cast<uchar *>(packedEdges.data()) + (int(filter)*4 + int(edge))*3*stride;
+    for (int i = 0; i < size; ++i) {
+        const AvgColor &c = colors.at(i);
+        packed[i] = uchar(qBound(0, qRound(c.red), 255));
+        packed[stride + i] = uchar(qBound(0, qRound(c.green), 255));
+        packed[2*stride + i] = uchar(qBound(0, qRound(c.blue), 255));
+    }
+}
+
+quint32 Tile::sumOfAbsoluteDifferences(const uchar *a, const uchar *b, int length)
+{
+    // length is a multiple of 16
+#ifdef __SSE2__
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < length; i += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+    }
+    // One partial sum in the low 32 bits of each 64 bit half
+    return quint32(_mm_cvtsi128_si32(sum)) + quint32(_mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+#else
+    quint32 sum = 0;
+    for (int i = 0; i < length; ++i) {
+        sum += quint32(abs(int(a[i]) - int(b[i])));
+    }
+    return sum;
+#endif
+}
+
+void Tile::precalcGradients()
+{
+    boundaryPixels = QByteArray(4*3*size, 0);
+    const int last = size - 1;
+    const int inner = qMax(size - 2, 0);
+    for (int e = Top; e <= Left; ++e) {
+        const Edge edge = Edge(e);
+        uchar *line = reinterpret_cast<uchar *>(boundaryPixels.data()) + e*3*size;
+        double sum[3] = {0, 0, 0};
+        double products[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+        for (int i = 0; i < size; ++i) {
+            QPoint outer;
+            QPoint next;
+            switch (edge) {
+            case Top:
+                outer = QPoint(i, 0);
+                next = QPoint(i, qMin(1, last));
+                break;
+            case Right:
+                outer = QPoint(last, i);
+                next = QPoint(inner, i);
+                break;
+            case Bottom:
+                outer = QPoint(i, last);
+                next = QPoint(i, inner);
+                break;
+            case Left:
+                outer = QPoint(0, i);
+                next = QPoint(qMin(1, last), i);
+                break;
+            }
+            // Resized tiles can be shorter than wide
+            outer.setY(qMin(outer.y(), image.height() - 1));
+            next.setY(qMin(next.y(), image.height() - 1));
+            const QRgb outerPixel = image.pixel(outer);
+            const QRgb nextPixel = image.pixel(next);
+            const int outerColor[3] = {qRed(outerPixel), qGreen(outerPixel), qBlue(outerPixel)};
+            const int nextColor[3] = {qRed(nextPixel), qGreen(nextPixel), qBlue(nextPixel)};
+            double gradient[3];
+            for (int c = 0; c < 3; ++c) {
+                line[c*size + i] = uchar(outerColor[c]);
+                gradient[c] = outerColor[c] - nextColor[c];
+                sum[c] += gradient[c];
+            }
+            for (int a = 0; a < 3; ++a) {
+                for (int b = 0; b < 3; ++b) {
+                    products[a][b] += gradient[a]*gradient[b];
+                }
+            }
+        }
+        // Covariance, regularized so flat edges stay invertible
+        double mean[3];
+        double cov[3][3];
+        for (int a = 0; a < 3; ++a) {
+            mean[a] = sum[a]/size;
+        }
+        for (int a = 0; a < 3; ++a) {
+            for (int b = 0; b < 3; ++b) {
+                cov[a][b] = products[a][b]/size - mean[a]*mean[b] + (a == b ? 1.0 : 0.0);
+            }
+        }
+        // Inverse by adjugate
+        const double det = cov[0][0]*(cov[1][1]*cov[2][2] - cov[1][2]*cov[2][1])
+                - cov[0][1]*(cov[1][0]*cov[2][2] - cov[1][2]*cov[2][0])
+                + cov[0][2]*(cov[1][0]*cov[2][1] - cov[1][1]*cov[2][0]);
+        GradientStats &stats = gradientStats[e];
+        for (int a = 0; a < 3; ++a) {
+            stats.mean[a] = float(mean[a]);
+            for (int b = 0; b < 3; ++b) {
+                const int r0 = (b + 1) % 3;
+                const int r1 = (b + 2) % 3;
+                const int c0 = (a + 1) % 3;
+                const int c1 = (a + 2) % 3;
+                stats.inverseCovariance[a][b] = float((cov[r0][c0]*cov[r1][c1] - cov[r0][c1]*cov[r1][c0])/det);
+            }
+        }
+    }
+}
+
+void Tile::classify()
+{
+    kind = Textured;
+    if (size == 0) {
+        return;
+    }
+    // The boundary lines are cheap to check and rule out most tiles
+    const uchar *top = boundaryLine(Top);
+    const QRgb color = qRgb(top[0], top[size], top[2*size]);
+    for (int e = Top; e <= Left; ++e) {
+        const uchar *line = boundaryLine(Edge(e));
+        for (int i = 0; i < size; ++i) {
+            if (qRgb(line[i], line[size + i], line[2*size + i]) != color) {
+                return;
+            }
+        }
+    }
+    // Classified while the pixels are at hand
+    const QImage pixels = (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32)
+            ? image : image.convertToFormat(QImage::Format_RGB32);
+    for (int y = 0; y < pixels.height(); ++y) {
+        const QRgb *scanLine = reinterpret_cast<const QRgb *>(pixels.constScanLine(y));
+        for (int x = 0; x < pixels.width(); ++x) {
+            if ((scanLine[x] | 0xff000000u) != color) {
+                return;
+            }
+        }
+    }
+    kind = Solid;
+    solidColor = color;
+}
+
+const uchar *Tile::boundaryLine(Tile::Edge edge) const
+{
+    return reinterpret_cast<const uchar *>(boundaryPixels.constData()) + int(edge)*3*size;
+}
+
+double Tile::mahalanobisSum(const uchar *from, const uchar *to, const Tile::GradientStats &stats, int length)
+{
+    const float (&m)[3][3] = stats.inverseCovariance;
+    const float m01 = m[0][1] + m[1][0];
+    const float m02 = m[0][2] + m[2][0];
+    const float m12 = m[1][2] + m[2][1];
+    float sum = 0.0f;
+    int i = 0;
+#ifdef __SSE2__
+    // Four samples at a time from the planar layout
+    const __m128i zero = _mm_setzero_si128();
+    __m128 sums = _mm_setzero_ps();
+    for (; i + 4 <= length; i += 4) {
+        __m128 d[3];
+        for (int c = 0; c < 3; ++c) {
+            int fromBytes;
+            int toBytes;
+            memcpy(&fromBytes, from + c*length + i, 4);
+            memcpy(&toBytes, to + c*length + i, 4);
+            const __m128i fromInts = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(fromBytes), zero), zero);
+            const __m128i toInts = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(toBytes), zero), zero);
+            d[c] = _mm_sub_ps(_mm_cvtepi32_ps(_mm_sub_epi32(toInts, fromInts)), _mm_set1_ps(stats.mean[c]));
+        }
+        __m128 q = _mm_mul_ps(_mm_set1_ps(m[0][0]), _mm_mul_ps(d[0], d[0]));
+        q = _mm_add_ps(q, _mm_mul_ps(_mm_set1_ps(m[1][1]), _mm_mul_ps(d[1], d[1])));
+        q = _mm_add_ps(q, _mm_mul_ps(_mm_set1_ps(m[2][2]), _mm_mul_ps(d[2], d[2])));
+        q = _mm_add_ps(q, _mm_mul_ps(_mm_set1_ps(m01), _mm_mul_ps(d[0], d[1])));
+        q = _mm_add_ps(q, _mm_mul_ps(_mm_set1_ps(m02), _mm_mul_ps(d[0], d[2])));
+        q = _mm_add_ps(q, _mm_mul_ps(_mm_set1_ps(m12), _mm_mul_ps(d[1], d[2])));
+        sums = _mm_add_ps(sums, q);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, sums);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < length; ++i) {
+        const float r = float(to[i]) - float(from[i]) - stats.mean[0];
+        const float g = float(to[length + i]) - float(from[length + i]) - stats.mean[1];
+        const float b = float(to[2*length + i]) - float(from[2*length + i]) - stats.mean[2];
+        sum += m[0][0]*r*r + m[1][1]*g*g + m[2][2]*b*b + m01*r*g + m02*r*b + m12*g*b;
+    }
+    return sum;
+}
+
 int Tile::calcNumUniqueEdgeColors(Tile::Edge edge, Tile::Filter filter)
 {
     QSet<unsigned int> edgeColorsHistogram;
@@ -158,6 +487,16 @@ void Tile::precalcEdgeColors()
     gauss15Edges.insert(Edge::Bottom, edgeColors(0, size - 1, 1, 0, Filter::Gauss15));
     gauss15Edges.insert(Edge::Left, edgeColors(0, 0, 0, 1, Filter::Gauss15));
     edgeColorsByFilter.insert(Filter::Gauss15, gauss15Edges);
+    if (edgeMetric == Sad) {
+        // Keep only the packed profiles
+        packedEdges = QByteArray(NUM_FILTERS*4*3*packedStride(), 0);
+        for (auto f = edgeColorsByFilter.constBegin(); f != edgeColorsByFilter.constEnd(); ++f) {
+            for (auto e = f.value().constBegin(); e != f.value().constEnd(); ++e) {
+                packEdgeColors(e.key(), f.key(), e.value());
+            }
+        }
+        edgeColorsByFilter.clear();
+    }
     // Unique colors per edge
     QHash<Edge, int> gauss1Uniques;
     gauss1Uniques.insert(Edge::Top, calcNumUniqueEdgeColors(Edge::Top, Filter::Gauss1));
@@ -31,6 +31,31 @@ class Tile
 public:
     enum Edge {Top, Right, Bottom, Left};
     enum Filter {Gauss1, Gauss6, Gauss15};
+    static const int NUM_FILTERS = 3;
+    //
+    // Euclidean: edge profiles are kept as fractional RGB values and compared
+    // by Euclidean color distance.
+    // Sad: edge profiles are kept as rounded 8 bit RGB planes and compared by
+    // sum of absolute differences, which needs an eighth of the memory.
+    //
+    enum EdgeMetric {Euclidean, Sad};
+    //
+    // Metric of the tiles in the store. Only read and written on the GUI
+    // thread; workers get the metric passed in.
+    //
+    static EdgeMetric g_edgeMetric;
+    //
+    // Edge scorers. Colors*: compare the smoothed boundary colors with the
+    // edge metric. Gradients: predict the pixels across the edge from the
+    // gradients between the two outermost pixel lines of each tile, scored
+    // by Mahalanobis distance (MGC).
+    //
+    enum Scorer {ColorsGauss1, ColorsGauss6, ColorsGauss15, Gradients};
+    //
+    // Average squared Mahalanobis distance per sample at which the gradient
+    // score is 0.5
+    //
+    static const double GRADIENT_SCALE;
     //
     // Helper struct to store fractional RGB values
     //
@@ -54,16 +79,69 @@ public:
     //
     bool isResized = false;
     bool isDuplicate = false;
+    //
+    // Removed from the store; the index stays valid, but the tile is never
+    // shown or recommended again
+    //
+    bool isRemoved = false;
+    //
+    // Solid tiles have a single color throughout and are interchangeable.
+    // A uniform border alone is not enough, the interior may hold an icon
+    // or text.
+    //
+    enum Kind {Solid, Textured};
+    Kind kind = Textured;
+    QRgb solidColor = 0;
 
-    Tile(QString filename);
-    Tile(QImage image, bool isResized, bool isDuplicate);
+    Tile() {}
+    //
+    // Edge profiles are computed for the given metric
+    //
+    Tile(QString filename, EdgeMetric metric);
+    Tile(QImage image, bool isResized, bool isDuplicate, EdgeMetric metric);
 
     bool isNull() const;
-    Edge oppositeEdge(Edge e);
+    Edge oppositeEdge(Edge e) const;
     QImage getImage() const;
+    //
+    // Release pixel data once it has been handed to the tile store; the
+    // precalculated features stay available
+    //
+    void dropImage();
     QVector<AvgColor> getEdgeColors(Edge edge, Filter filter);
+    //
+    // Similarity between 0 and 1. Tiles using the Sad metric are compared by
+    // sum of absolute differences, scaled to match the Euclidean metric for
+    // gray level differences.
+    //
     double calcEdgeSimilarity(Tile &other, Filter filter, Edge edge);
     int getNumUniqueEdgeColors(Edge edge, Filter filter);
+    double calcGradientCompatibility(Tile &other, Edge edge);
+    double calcEdgeScore(Tile &other, Scorer scorer, Edge edge);
+    //
+    // Hash of the outermost pixel line of an edge, with the lowest shift bits
+    // of each channel dropped
+    //
+    quint32 boundaryHash(Edge edge, int shift) const;
+    //
+    // True if the outermost pixel line of edge equals the one of the opposite
+    // edge of other, with the lowest shift bits of each channel dropped
+    //
+    bool continuesInto(const Tile &other, Edge edge, int shift) const;
+    //
+    // True if the outermost pixel line of edge has a single color, with the
+    // lowest shift bits of each channel dropped
+    //
+    bool isUniformBoundary(Edge edge, int shift) const;
+    //
+    // Filter whose edge colors the scorer is based on
+    //
+    static Filter filterOf(Scorer scorer);
+    EdgeMetric getEdgeMetric() const;
+    //
+    // Memory used by the edge profiles in bytes
+    //
+    int featureBytes() const;
 
 private:
     static const int Gauss1Kernel[5][5];
@@ -71,6 +149,7 @@ private:
     static const int Gauss15Kernel[5][5];
 
     QImage image;
+    EdgeMetric edgeMetric = Euclidean;
     //
     // Arrays storing gaussian-filtered color values for all edges and filters
     //
@@ -79,11 +158,42 @@ private:
     // Number of unique colors per edge
     //
     QHash<Filter, QHash<Edge, int>> numUniqueEdgeColors;
+    //
+    // Sad metric: R, G and B planes of each filter and edge, every plane
+    // padded with zeros to a multiple of 16 bytes
+    //
+    QByteArray packedEdges;
+
+    int packedStride() const;
+    const uchar *packedEdge(Edge edge, Filter filter) const;
+    void packEdgeColors(Edge edge, Filter filter, const QVector<AvgColor> &colors);
+    //
+    // Gradient statistics of an edge, pointing outwards
+    //
+    struct GradientStats {
+        float mean[3];
+        float inverseCovariance[3][3];
+    };
+    //
+    // R, G and B planes of the outermost pixel line of each edge
+    //
+    QByteArray boundaryPixels;
+    GradientStats gradientStats[4];
+
+    void precalcGradients();
+    void classify();
+    const uchar *boundaryLine(Edge edge) const;
+    //
+    // Sum of squared Mahalanobis distances of the gradients from one
+    // boundary line to the other, given the statistics of the first tile
+    //
+    static double mahalanobisSum(const uchar *from, const uchar *to, const GradientStats &stats, int length);
 
     int calcNumUniqueEdgeColors(Edge edge, Filter filter);
     void precalcEdgeColors();
     QVector<AvgColor> edgeColors(int startX, int startY, int deltaX, int deltaY, Filter filter);
     int getGaussKernelValue(int x, int y, Filter filter);
+    static quint32 sumOfAbsoluteDifferences(const uchar *a, const uchar *b, int length);
 };
 
 #endif // TILE_H
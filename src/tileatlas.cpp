@@ -0,0 +1,164 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tileatlas.h"
+
+#include <algorithm>
+
+#include "tilestore.h"
+
+const int TileAtlas::PAGE_SIZE = 2048;
+const int TileAtlas::MEMORY_LIMIT_MB = 256;
+const double TileAtlas::USED_TILE_OPACITY = 0.25;
+
+TileAtlas::TileAtlas(TileStore *tileStore)
+    : tileStore(tileStore),
+      tileSize(0),
+      slotsPerRow(0),
+      slotsPerPage(0),
+      capacity(0),
+      clockHand(0),
+      hits(0),
+      misses(0)
+{
+}
+
+void TileAtlas::reset()
+{
+    pages.clear();
+    slotOfKey.clear();
+    keyOfSlot.clear();
+    referenced.clear();
+    clockHand = 0;
+    hits = 0;
+    misses = 0;
+    tileSize = tileStore->tileSize;
+    if (tileSize <= 0 || tileSize > PAGE_SIZE) {
+        slotsPerRow = 0;
+        slotsPerPage = 0;
+        capacity = 0;
+        return;
+    }
+    slotsPerRow = PAGE_SIZE/tileSize;
+    slotsPerPage = slotsPerRow*slotsPerRow;
+    const qint64 pageBytes = qint64(PAGE_SIZE)*PAGE_SIZE*4;
+    const int maxPages = std::max(1, int(qint64(MEMORY_LIMIT_MB)*1024*1024/pageBytes));
+    capacity = maxPages*slotsPerPage;
+    // Pre-populate with the plain variant of as many tiles as fit
+    const int numInitial = std::min(tileStore->size(), capacity);
+    for (int i = 0; i < numInitial; ++i) {
+        const int slot = acquireSlot();
+        upload(slot, i, false);
+        slotOfKey.insert(2*i, slot);
+        keyOfSlot[slot] = 2*i;
+    }
+}
+
+void TileAtlas::draw(QPainter &painter, int x, int y, int index, bool faded)
+{
+    const int slot = slotFor(index, faded);
+    if (slot != -1) {
+        painter.drawPixmap(QPoint(x, y), pages.at(slot/slotsPerPage), slotRect(slot));
+    }
+}
+
+void TileAtlas::draw(QPainter &painter, const QRect &target, int index, bool faded)
+{
+    const int slot = slotFor(index, faded);
+    if (slot != -1) {
+        painter.drawPixmap(target, pages.at(slot/slotsPerPage), slotRect(slot));
+    }
+}
+
+int TileAtlas::slotFor(int index, bool faded)
+{
+    if (capacity == 0 || tileStore->tileSize != tileSize) {
+        reset();
+        if (capacity == 0) {
+            return -1;
+        }
+    }
+    const int key = 2*index + (faded ? 1 : 0);
+    int slot = slotOfKey.value(key, -1);
+    if (slot != -1) {
+        hits++;
+    } else {
+        misses++;
+        slot = acquireSlot();
+        upload(slot, index, faded);
+        slotOfKey.insert(key, slot);
+        keyOfSlot[slot] = key;
+    }
+    referenced[slot] = true;
+    return slot;
+}
+
+QString TileAtlas::report()
+{
+    const quint64 lookups = hits + misses;
+    const double hitRate = (lookups > 0) ? 100.0*hits/lookups : 0.0;
+    return QString("Tile atlas: ") + QString::number(pages.size()) + " pages of "
+            + QString::number(PAGE_SIZE) + "x" + QString::number(PAGE_SIZE) + " pixels\n"
+            + "Atlas slots in use: " + QString::number(keyOfSlot.size()) + " of " + QString::number(capacity) + "\n"
+            + "Atlas hit rate: " + QString::number(hitRate, 'f', 1) + "%";
+}
+
+int TileAtlas::acquireSlot()
+{
+    if (keyOfSlot.size() < capacity) {
+        const int slot = keyOfSlot.size();
+        if (slot % slotsPerPage == 0) {
+            QPixmap page(PAGE_SIZE, PAGE_SIZE);
+            page.fill(Qt::transparent);
+            pages.append(page);
+        }
+        keyOfSlot.append(-1);
+        referenced.append(false);
+        return slot;
+    }
+    // Clock: skip slots that have been used since the hand passed them last
+    while (referenced.at(clockHand)) {
+        referenced[clockHand] = false;
+        clockHand = (clockHand + 1) % capacity;
+    }
+    const int slot = clockHand;
+    clockHand = (clockHand + 1) % capacity;
+    slotOfKey.remove(keyOfSlot.at(slot));
+    keyOfSlot[slot] = -1;
+    return slot;
+}
+
+void TileAtlas::upload(int slot, int index, bool faded)
+{
+    const QRect rect = slotRect(slot);
+    QPainter painter(&pages[slot/slotsPerPage]);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.fillRect(rect, Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    if (faded) {
+        painter.setOpacity(USED_TILE_OPACITY);
+    }
+    painter.drawImage(rect.topLeft(), tileStore->getImage(index));
+}
+
+QRect TileAtlas::slotRect(int slot) const
+{
+    const int inPage = slot % slotsPerPage;
+    return QRect((inPage % slotsPerRow)*tileSize, (inPage/slotsPerRow)*tileSize, tileSize, tileSize);
+}
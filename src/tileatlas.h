@@ -0,0 +1,89 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILEATLAS_H
+#define TILEATLAS_H
+
+#include <QPixmap>
+#include <QPainter>
+#include <QHash>
+#include <QVector>
+#include <QString>
+
+class TileStore;
+
+//
+// Tiles converted to the native pixmap format, packed into a few large
+// atlas pages. Each slot holds a tile either as is or in its faded "used"
+// variant. When all slots are taken, slots are recycled with the clock
+// (second chance) algorithm. Must only be used from the GUI thread.
+//
+class TileAtlas
+{
+public:
+    //
+    // Edge length of an atlas page in pixels
+    //
+    static const int PAGE_SIZE;
+    //
+    // Upper bound for the size of all pages, in megabytes
+    //
+    static const int MEMORY_LIMIT_MB;
+    static const double USED_TILE_OPACITY;
+
+    TileAtlas(TileStore *tileStore);
+
+    //
+    // Drop all slots and upload as many tiles as fit, starting with the first
+    //
+    void reset();
+    void draw(QPainter &painter, int x, int y, int index, bool faded = false);
+    //
+    // Draw scaled to the target rectangle
+    //
+    void draw(QPainter &painter, const QRect &target, int index, bool faded = false);
+    QString report();
+
+private:
+    TileStore *tileStore;
+    int tileSize;
+    int slotsPerRow;
+    int slotsPerPage;
+    int capacity;
+    QVector<QPixmap> pages;
+    //
+    // Slot lookup by key (tile index times two, plus one for faded tiles)
+    //
+    QHash<int, int> slotOfKey;
+    QVector<int> keyOfSlot;
+    QVector<bool> referenced;
+    int clockHand;
+    quint64 hits;
+    quint64 misses;
+
+    //
+    // Return slot holding the tile, uploading it if necessary
+    //
+    int slotFor(int index, bool faded);
+    int acquireSlot();
+    void upload(int slot, int index, bool faded);
+    QRect slotRect(int slot) const;
+};
+
+#endif // TILEATLAS_H
@@ -0,0 +1,125 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tilebitset.h"
+
+#include <QtAlgorithms>
+#include <algorithm>
+
+void TileBitset::resize(int size)
+{
+    numBits = size;
+    words.resize((size + 63)/64);
+    clearTail();
+}
+
+void TileBitset::fill(bool value)
+{
+    words.fill(value ? ~quint64(0) : 0);
+    clearTail();
+}
+
+void TileBitset::clearTail()
+{
+    // Keep bits beyond the end cleared, so counting can work on whole words
+    if (numBits & 63) {
+        words.last() &= (quint64(1) << (numBits & 63)) - 1;
+    }
+    rankValid = false;
+}
+
+void TileBitset::set(int index, bool value)
+{
+    Q_ASSERT(index >= 0 && index < numBits);
+    const quint64 mask = quint64(1) << (index & 63);
+    quint64 &word = words[index >> 6];
+    const quint64 newWord = value ? (word | mask) : (word & ~mask);
+    if (newWord != word) {
+        word = newWord;
+        rankValid = false;
+    }
+}
+
+int TileBitset::next(int index) const
+{
+    if (index >= numBits) {
+        return -1;
+    }
+    int w = index >> 6;
+    quint64 word = words.at(w) & (~quint64(0) << (index & 63));
+    while (word == 0) {
+        if (++w == words.size()) {
+            return -1;
+        }
+        word = words.at(w);
+    }
+    return w*64 + int(qCountTrailingZeroBits(word));
+}
+
+int TileBitset::count() const
+{
+    buildRank();
+    return rankBase.last();
+}
+
+int TileBitset::rank(int index) const
+{
+    buildRank();
+    if (index >= numBits) {
+        return rankBase.last();
+    }
+    const quint64 mask = (quint64(1) << (index & 63)) - 1;
+    return rankBase.at(index >> 6) + int(qPopulationCount(words.at(index >> 6) & mask));
+}
+
+int TileBitset::select(int rank) const
+{
+    buildRank();
+    if (rank < 0 || rank >= rankBase.last()) {
+        return -1;
+    }
+    // Last word whose prefix count is <= rank
+    const int w = int(std::upper_bound(rankBase.constBegin(), rankBase.constEnd() - 1, rank) - rankBase.constBegin()) - 1;
+    quint64 word = words.at(w);
+    for (int skip = rank - rankBase.at(w); skip > 0; --skip) {
+        word &= word - 1;
+    }
+    return w*64 + int(qCountTrailingZeroBits(word));
+}
+
+quint64 *TileBitset::wordsForWriting()
+{
+    rankValid = false;
+    return words.data();
+}
+
+void TileBitset::buildRank() const
+{
+    if (rankValid) {
+        return;
+    }
+    rankBase.resize(words.size() + 1);
+    int total = 0;
+    for (int w = 0; w < words.size(); ++w) {
+        rankBase[w] = total;
+        total += int(qPopulationCount(words.at(w)));
+    }
+    rankBase[words.size()] = total;
+    rankValid = true;
+}
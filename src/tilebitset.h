@@ -0,0 +1,77 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILEBITSET_H
+#define TILEBITSET_H
+
+#include <QVector>
+
+//
+// Fixed-size set of tile indices, packed 64 per word. Rank queries (number
+// of set bits before an index) use per-word prefix counts, which are rebuilt
+// lazily after modifications.
+//
+class TileBitset
+{
+public:
+    TileBitset() : numBits(0), rankValid(false) {}
+
+    void resize(int size);
+    int size() const { return numBits; }
+    void fill(bool value);
+    void set(int index, bool value);
+    bool test(int index) const
+    {
+        return (words.at(index >> 6) >> (index & 63)) & 1;
+    }
+    //
+    // Index of the first set bit >= index, or -1 if there is none
+    //
+    int next(int index) const;
+    int count() const;
+    //
+    // Number of set bits at positions < index
+    //
+    int rank(int index) const;
+    //
+    // Index of the set bit with the given rank, or -1 if out of range
+    //
+    int select(int rank) const;
+
+    const quint64 *constWords() const { return words.constData(); }
+    //
+    // Direct word access for bulk operations; call clearTail() afterwards
+    //
+    quint64 *wordsForWriting();
+    int numWords() const { return words.size(); }
+    void clearTail();
+
+private:
+    int numBits;
+    QVector<quint64> words;
+    //
+    // Number of set bits in all words before each word, plus the total
+    //
+    mutable QVector<int> rankBase;
+    mutable bool rankValid;
+
+    void buildRank() const;
+};
+
+#endif // TILEBITSET_H
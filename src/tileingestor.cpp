@@ -0,0 +1,186 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tileingestor.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QtConcurrent>
+
+const int TileIngestor::SCAN_DELAY_MS = 500;
+const int TileIngestor::MAX_ATTEMPTS = 10;
+const int TileIngestor::BATCH_SIZE = 256;
+
+TileIngestor::TileIngestor(TileStore *tileStore, QObject *parent)
+    : QObject(parent),
+      tileStore(tileStore),
+      numAdded(0),
+      numRejected(0),
+      numFailed(0),
+      numWaiting(0),
+      suspendCount(0),
+      batchPending(false)
+{
+    scanTimer.setSingleShot(true);
+    scanTimer.setInterval(SCAN_DELAY_MS);
+    connect(&scanTimer, SIGNAL(timeout()), this, SLOT(scan()));
+    connect(&watcher, SIGNAL(directoryChanged(QString)), &scanTimer, SLOT(start()));
+    connect(&loader, SIGNAL(finished()), this, SLOT(batchFinished()));
+}
+
+TileIngestor::~TileIngestor()
+{
+    loader.waitForFinished();
+}
+
+void TileIngestor::start(const QString &dir)
+{
+    stop();
+    this->dir = dir;
+    watcher.addPath(dir);
+    scan();
+}
+
+void TileIngestor::stop()
+{
+    if (!dir.isEmpty()) {
+        watcher.removePath(dir);
+    }
+    scanTimer.stop();
+    // A running batch is discarded when it finishes
+    dir.clear();
+    batchPending = false;
+    done.clear();
+    lastSize.clear();
+    attempts.clear();
+    numAdded = 0;
+    numRejected = 0;
+    numFailed = 0;
+    numWaiting = 0;
+    emit statusChanged(QString());
+}
+
+bool TileIngestor::isActive() const
+{
+    return !dir.isEmpty();
+}
+
+void TileIngestor::suspend()
+{
+    suspendCount++;
+}
+
+void TileIngestor::resume()
+{
+    Q_ASSERT(suspendCount > 0);
+    if (--suspendCount > 0) {
+        return;
+    }
+    if (batchPending) {
+        batchPending = false;
+        batchFinished();
+    } else if (!dir.isEmpty()) {
+        scan();
+    }
+}
+
+void TileIngestor::scan()
+{
+    if (dir.isEmpty() || loader.isRunning() || batchPending || suspendCount > 0) {
+        // batchFinished or resume scans again
+        return;
+    }
+    const QFileInfoList files = QDir(dir).entryInfoList(QStringList() << "*.bmp", QDir::Files, QDir::Name);
+    QStringList ready;
+    numWaiting = 0;
+    foreach (const QFileInfo &info, files) {
+        const QString path = info.absoluteFilePath();
+        if (done.contains(path)) {
+            continue;
+        }
+        // Still being written if the size changed since the last scan
+        const qint64 size = info.size();
+        if (size == 0 || lastSize.value(path, -1) != size) {
+            lastSize.insert(path, size);
+            numWaiting++;
+        } else if (ready.size() < BATCH_SIZE) {
+            ready.append(path);
+        } else {
+            numWaiting++;
+        }
+    }
+    if (!ready.isEmpty()) {
+        batchDir = dir;
+        const Tile::EdgeMetric metric = Tile::g_edgeMetric;
+        loader.setFuture(QtConcurrent::run([ready, metric]() {
+            QVector<TileStore::CacheTile> tiles;
+            foreach (const QString &path, ready) {
+                tiles.append(TileStore::readCacheTile(path, metric));
+            }
+            return tiles;
+        }));
+    } else if (numWaiting > 0) {
+        // Writing a file does not necessarily change the directory
+        scanTimer.start();
+    }
+    reportStatus();
+}
+
+void TileIngestor::batchFinished()
+{
+    if (dir.isEmpty()) {
+        return;
+    }
+    if (suspendCount > 0) {
+        batchPending = true;
+        return;
+    }
+    if (batchDir != dir) {
+        // Started for another directory meanwhile
+        scan();
+        return;
+    }
+    QVector<TileStore::CacheTile> tiles = loader.result();
+    QVector<TileStore::CacheTile> readable;
+    for (int i = 0; i < tiles.size(); ++i) {
+        const QString &path = tiles.at(i).path;
+        if (!tiles.at(i).tile.isNull()) {
+            readable.append(tiles.at(i));
+            done.insert(path);
+        } else if (++attempts[path] >= MAX_ATTEMPTS) {
+            numFailed++;
+            done.insert(path);
+        } else {
+            // Possibly incomplete: wait for a stable size again
+            lastSize.remove(path);
+        }
+    }
+    numAdded += tileStore->ingestTiles(dir, readable, &numRejected);
+    scan();
+}
+
+void TileIngestor::reportStatus()
+{
+    if (dir.isEmpty()) {
+        return;
+    }
+    emit statusChanged(QString("Watching ") + dir + ": " + QString::number(numAdded) + " tiles added, "
+                       + QString::number(numWaiting) + " files waiting, "
+                       + QString::number(numRejected + numFailed) + " failed");
+}
@@ -0,0 +1,108 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILEINGESTOR_H
+#define TILEINGESTOR_H
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QTimer>
+#include <QSet>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "tilestore.h"
+
+//
+// Appends tiles to the store while cache files are still being extracted
+// into a directory. A file is picked up once its size has not changed
+// between two scans. Files are read in the background, and files that
+// cannot be decoded yet are retried a few times.
+//
+class TileIngestor : public QObject
+{
+    Q_OBJECT
+
+public:
+    //
+    // Delay between a directory change and the next scan
+    //
+    static const int SCAN_DELAY_MS;
+    //
+    // Decoding attempts before a file is given up
+    //
+    static const int MAX_ATTEMPTS;
+    //
+    // Files read in one background batch
+    //
+    static const int BATCH_SIZE;
+
+    TileIngestor(TileStore *tileStore, QObject *parent = 0);
+    ~TileIngestor();
+
+    void start(const QString &dir);
+    void stop();
+    bool isActive() const;
+    //
+    // Hold back tiles while an operation that relies on a fixed store size
+    // runs behind a progress dialog. Calls nest; a batch that finishes in
+    // between is added on the last resume.
+    //
+    void suspend();
+    void resume();
+
+signals:
+    void statusChanged(const QString &status);
+
+private slots:
+    void scan();
+    void batchFinished();
+
+private:
+    TileStore *tileStore;
+    QString dir;
+    //
+    // Directory of the batch being read
+    //
+    QString batchDir;
+    QFileSystemWatcher watcher;
+    QTimer scanTimer;
+    QFutureWatcher<QVector<TileStore::CacheTile>> loader;
+    //
+    // Files added, rejected or given up
+    //
+    QSet<QString> done;
+    //
+    // Size of files at the last scan, to detect files still being written
+    //
+    QHash<QString, qint64> lastSize;
+    QHash<QString, int> attempts;
+    int numAdded;
+    int numRejected;
+    int numFailed;
+    int numWaiting;
+    int suspendCount;
+    bool batchPending;
+
+    void reportStatus();
+};
+
+#endif // TILEINGESTOR_H
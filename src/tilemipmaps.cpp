@@ -0,0 +1,114 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tilemipmaps.h"
+
+#include <QtConcurrent>
+
+#include "tilestore.h"
+
+TileMipmaps::TileMipmaps(TileStore *tileStore)
+    : tileStore(tileStore)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(batchFinished()));
+}
+
+TileMipmaps::~TileMipmaps()
+{
+    watcher.waitForFinished();
+}
+
+void TileMipmaps::reset()
+{
+    watcher.waitForFinished();
+    QMutexLocker locker(&mutex);
+    levels.clear();
+    queue.clear();
+    queued.clear();
+}
+
+QImage TileMipmaps::image(int index, int level)
+{
+    Q_ASSERT(level >= 1 && level <= MAX_LEVEL);
+    {
+        QMutexLocker locker(&mutex);
+        auto it = levels.constFind(index);
+        if (it != levels.constEnd()) {
+            return it->at(level - 1);
+        }
+        if (!queued.contains(index)) {
+            queued.insert(index);
+            queue.append(index);
+        }
+    }
+    startBatch();
+    return QImage();
+}
+
+int TileMipmaps::size()
+{
+    QMutexLocker locker(&mutex);
+    return levels.size();
+}
+
+void TileMipmaps::batchFinished()
+{
+    emit mipmapsReady();
+    // Requests that came in while the batch was running
+    startBatch();
+}
+
+void TileMipmaps::startBatch()
+{
+    if (watcher.isRunning()) {
+        return;
+    }
+    QVector<int> batch;
+    {
+        QMutexLocker locker(&mutex);
+        batch.swap(queue);
+    }
+    if (batch.isEmpty()) {
+        return;
+    }
+    watcher.setFuture(QtConcurrent::run([this, batch]() {
+        generate(batch);
+    }));
+}
+
+void TileMipmaps::generate(const QVector<int> &indices)
+{
+    foreach (int index, indices) {
+        QImage image = tileStore->getImage(index);
+        if (image.isNull()) {
+            continue;
+        }
+        // Each level is scaled from the previous one
+        QVector<QImage> mipmaps;
+        for (int level = 1; level <= MAX_LEVEL; ++level) {
+            const int width = std::max(1, image.width()/2);
+            const int height = std::max(1, image.height()/2);
+            image = image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            mipmaps.append(image.convertToFormat(QImage::Format_ARGB32_Premultiplied));
+        }
+        QMutexLocker locker(&mutex);
+        levels.insert(index, mipmaps);
+        queued.remove(index);
+    }
+}
@@ -0,0 +1,80 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILEMIPMAPS_H
+#define TILEMIPMAPS_H
+
+#include <QObject>
+#include <QImage>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QMutex>
+#include <QFutureWatcher>
+
+class TileStore;
+
+//
+// Downscaled versions of tiles for zoomed out views. Level n has 1/2^n of
+// the tile size. Mipmaps are generated on a background thread for the
+// tiles that are asked for; until then, image() returns a null image.
+//
+class TileMipmaps : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int MAX_LEVEL = 4;
+
+    TileMipmaps(TileStore *tileStore);
+    ~TileMipmaps();
+
+    //
+    // Discard all mipmaps, waiting for running generation to finish
+    //
+    void reset();
+    //
+    // Return mipmap for level 1..MAX_LEVEL, or a null image if it is not
+    // available yet, in which case it will be generated
+    //
+    QImage image(int index, int level);
+    int size();
+
+signals:
+    //
+    // Emitted in the GUI thread after a batch of mipmaps has been generated
+    //
+    void mipmapsReady();
+
+private slots:
+    void batchFinished();
+
+private:
+    TileStore *tileStore;
+    QMutex mutex;
+    QHash<int, QVector<QImage>> levels;
+    QVector<int> queue;
+    QSet<int> queued;
+    QFutureWatcher<void> watcher;
+
+    void startBatch();
+    void generate(const QVector<int> &indices);
+};
+
+#endif // TILEMIPMAPS_H
@@ -0,0 +1,289 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tilepixelpool.h"
+#include "compactimage.h"
+
+#include <QFile>
+#include <QDataStream>
+#include <QMutexLocker>
+#include <algorithm>
+
+const int TilePixelPool::DEFAULT_MEMORY_LIMIT_MB = 512;
+
+TilePixelPool::TilePixelPool() :
+    residentSize(0),
+    compact(false),
+    encodedSize(0),
+    encodedRawSize(0),
+    generation(0),
+    hits(0),
+    misses(0)
+{
+    cache.setMaxCost(DEFAULT_MEMORY_LIMIT_MB*1024);
+}
+
+void TilePixelPool::clear()
+{
+    QMutexLocker locker(&mutex);
+    sources.clear();
+    resident.clear();
+    residentSize = 0;
+    encoded.clear();
+    encodedSize = 0;
+    encodedRawSize = 0;
+    cache.clear();
+    generation++;
+    hits = 0;
+    misses = 0;
+}
+
+int TilePixelPool::append(const QImage &image, const QString &path, qint64 offset)
+{
+    QMutexLocker locker(&mutex);
+    const int index = sources.size();
+    sources.append(Source(path, offset));
+    encoded.append(QByteArray());
+    if (compact) {
+        resident.append(QImage());
+        storeEncoded(index, CompactImage::encode(image), image);
+    } else if (path.isEmpty()) {
+        resident.append(image);
+        residentSize += image.byteCount();
+    } else {
+        resident.append(QImage());
+        // Keep the freshly decoded image around as long as there is room
+        if (!image.isNull()) {
+            cache.insert(index, new QImage(image), costOf(image));
+        }
+    }
+    return index;
+}
+
+void TilePixelPool::setSource(int index, const QString &path, qint64 offset)
+{
+    QMutexLocker locker(&mutex);
+    const QImage &image = resident.at(index);
+    if (!image.isNull()) {
+        // Resident image becomes pageable
+        residentSize -= image.byteCount();
+        cache.insert(index, new QImage(image), costOf(image));
+        resident.replace(index, QImage());
+    }
+    sources.replace(index, Source(path, offset));
+}
+
+void TilePixelPool::prime(int index, const QImage &image)
+{
+    QMutexLocker locker(&mutex);
+    if (compact) {
+        const quint64 primed = generation;
+        locker.unlock();
+        QByteArray data = CompactImage::encode(image);
+        locker.relock();
+        if (generation == primed) {
+            storeEncoded(index, data, image);
+        }
+    } else if (sources.at(index).path.isEmpty()) {
+        residentSize += image.byteCount() - resident.at(index).byteCount();
+        resident.replace(index, image);
+    } else if (!image.isNull()) {
+        cache.insert(index, new QImage(image), costOf(image));
+    }
+}
+
+QImage TilePixelPool::image(int index)
+{
+    QMutexLocker locker(&mutex);
+    // Background readers may still ask for tiles of a store that has been replaced
+    if (index < 0 || index >= sources.size()) {
+        return QImage();
+    }
+    if (!resident.at(index).isNull()) {
+        return resident.at(index);
+    }
+    QImage *cached = cache.object(index);
+    if (cached != NULL) {
+        hits++;
+        return *cached;
+    }
+    misses++;
+    // Do not block other readers while decoding
+    const quint64 readGeneration = generation;
+    if (!encoded.at(index).isEmpty()) {
+        QByteArray data = encoded.at(index);
+        locker.unlock();
+        QImage decoded = CompactImage::decode(data);
+        locker.relock();
+        if (generation == readGeneration) {
+            cache.insert(index, new QImage(decoded), costOf(decoded));
+        }
+        return decoded;
+    }
+    Source source = sources.at(index);
+    const bool encode = compact;
+    locker.unlock();
+    QImage loaded = loadFromSource(source);
+    QByteArray data;
+    if (encode) {
+        data = CompactImage::encode(loaded);
+    }
+    locker.relock();
+    if (generation != readGeneration) {
+        // The pool has been cleared meanwhile, the index may be out of range
+        return loaded;
+    }
+    if (compact && encoded.at(index).isEmpty()) {
+        storeEncoded(index, data, loaded);
+    }
+    cache.insert(index, new QImage(loaded), costOf(loaded));
+    return loaded;
+}
+
+int TilePixelPool::size()
+{
+    QMutexLocker locker(&mutex);
+    return sources.size();
+}
+
+void TilePixelPool::setMemoryLimit(int megabytes)
+{
+    QMutexLocker locker(&mutex);
+    cache.setMaxCost(megabytes*1024);
+}
+
+int TilePixelPool::getMemoryLimit()
+{
+    QMutexLocker locker(&mutex);
+    return cache.maxCost()/1024;
+}
+
+void TilePixelPool::setCompactEncoding(bool enable)
+{
+    QMutexLocker locker(&mutex);
+    if (enable == compact) {
+        return;
+    }
+    compact = enable;
+    for (int i = 0; i < sources.size(); ++i) {
+        if (enable && !resident.at(i).isNull()) {
+            storeEncoded(i, CompactImage::encode(resident.at(i)), resident.at(i));
+            residentSize -= resident.at(i).byteCount();
+            resident.replace(i, QImage());
+        } else if (!enable && !encoded.at(i).isEmpty()) {
+            if (sources.at(i).path.isEmpty()) {
+                // No other place to get pixels from
+                QImage image = CompactImage::decode(encoded.at(i));
+                resident.replace(i, image);
+                residentSize += image.byteCount();
+            }
+            encoded.replace(i, QByteArray());
+        }
+    }
+    if (!enable) {
+        encodedSize = 0;
+        encodedRawSize = 0;
+    }
+}
+
+bool TilePixelPool::getCompactEncoding()
+{
+    QMutexLocker locker(&mutex);
+    return compact;
+}
+
+qint64 TilePixelPool::residentBytes()
+{
+    QMutexLocker locker(&mutex);
+    return residentSize + encodedSize + qint64(cache.totalCost())*1024;
+}
+
+QString TilePixelPool::report()
+{
+    QMutexLocker locker(&mutex);
+    const quint64 requests = hits + misses;
+    const double hitRate = (requests > 0) ? 100.0*hits/requests : 100.0;
+    const qint64 total = residentSize + encodedSize + qint64(cache.totalCost())*1024;
+    QString result = QString("Tile pixels: ") + QString::number(sources.size()) + " tiles, "
+            + QString::number(cache.count()) + " paged in\n"
+            + "Resident memory: " + QString::number(total/(1024*1024)) + " MB"
+            + " (limit " + QString::number(cache.maxCost()/1024) + " MB for paged tiles)\n"
+            + "Cache hit rate: " + QString::number(hitRate, 'f', 1) + "% ("
+            + QString::number(hits) + " hits, " + QString::number(misses) + " misses)";
+    if (compact) {
+        int numPalette = 0;
+        int numRunLength = 0;
+        int numRaw = 0;
+        for (int i = 0; i < encoded.size(); ++i) {
+            if (!encoded.at(i).isEmpty()) {
+                switch (CompactImage::mode(encoded.at(i))) {
+                case CompactImage::Palette:
+                    numPalette++;
+                    break;
+                case CompactImage::RunLength:
+                    numRunLength++;
+                    break;
+                default:
+                    numRaw++;
+                    break;
+                }
+            }
+        }
+        const double ratio = (encodedSize > 0) ? double(encodedRawSize)/encodedSize : 1.0;
+        result += QString("\nCompact encoding: ") + QString::number(encodedSize/1024) + " KB for "
+                + QString::number(encodedRawSize/1024) + " KB of pixels (ratio "
+                + QString::number(ratio, 'f', 1) + ":1)\n"
+                + QString::number(numPalette) + " palette, " + QString::number(numRunLength)
+                + " run-length and " + QString::number(numRaw) + " raw tiles";
+    }
+    return result;
+}
+
+QImage TilePixelPool::loadFromSource(const Source &source)
+{
+    QImage image;
+    if (source.offset < 0) {
+        image.load(source.path);
+    } else {
+        QFile file(source.path);
+        if (file.open(QIODevice::ReadOnly) && file.seek(source.offset)) {
+            QDataStream in(&file);
+            in.setVersion(QDataStream::Qt_5_9);
+            in >> image;
+        }
+    }
+    return image;
+}
+
+void TilePixelPool::storeEncoded(int index, const QByteArray &data, const QImage &image)
+{
+    if (image.isNull() || data.isEmpty()) {
+        return;
+    }
+    encodedSize += data.size() - encoded.at(index).size();
+    if (encoded.at(index).isEmpty()) {
+        encodedRawSize += qint64(image.width())*image.height()*4;
+    }
+    encoded.replace(index, data);
+}
+
+int TilePixelPool::costOf(const QImage &image)
+{
+    return std::max(1, image.byteCount()/1024);
+}
@@ -0,0 +1,111 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILEPIXELPOOL_H
+#define TILEPIXELPOOL_H
+
+#include <QString>
+#include <QImage>
+#include <QVector>
+#include <QCache>
+#include <QMutex>
+
+//
+// Holds the pixel data of all tiles in a store. Tiles that have been read
+// from disk (cache directory or case file) are not kept resident, but are
+// paged in on demand into a bounded LRU cache. Optionally, pixels are kept
+// in memory in a compact encoding instead, with the LRU cache acting as the
+// scratch buffer for decoded images. All public methods are thread-safe.
+//
+class TilePixelPool
+{
+public:
+    //
+    // Default upper bound for paged-in tile pixels, in megabytes
+    //
+    static const int DEFAULT_MEMORY_LIMIT_MB;
+
+    TilePixelPool();
+
+    void clear();
+    //
+    // Add pixels for the next tile index. If path is empty, the image is kept
+    // resident. Otherwise it can be reloaded from path: a .bmp file if offset
+    // is -1, or a QDataStream-serialized QImage at offset in a case file.
+    //
+    int append(const QImage &image, const QString &path, qint64 offset);
+    void setSource(int index, const QString &path, qint64 offset);
+    //
+    // Provide already decoded pixels for a tile added without an image
+    //
+    void prime(int index, const QImage &image);
+    QImage image(int index);
+    int size();
+
+    void setMemoryLimit(int megabytes);
+    int getMemoryLimit();
+    void setCompactEncoding(bool enable);
+    bool getCompactEncoding();
+    qint64 residentBytes();
+    QString report();
+
+private:
+    struct Source {
+        QString path;
+        qint64 offset;
+
+        Source() : offset(-1) {}
+        Source(const QString &path, qint64 offset) : path(path), offset(offset) {}
+    };
+
+    QMutex mutex;
+    QVector<Source> sources;
+    //
+    // Images without a source; null for paged tiles
+    //
+    QVector<QImage> resident;
+    qint64 residentSize;
+    bool compact;
+    //
+    // CompactImage data; empty if not encoded (yet)
+    //
+    QVector<QByteArray> encoded;
+    qint64 encodedSize;
+    //
+    // Size the encoded images would need as plain 32 bit images
+    //
+    qint64 encodedRawSize;
+    //
+    // Cost is measured in kilobytes
+    //
+    QCache<int, QImage> cache;
+    //
+    // Incremented by clear, so a reader that decoded without holding the
+    // mutex does not store pixels under an index of another store
+    //
+    quint64 generation;
+    quint64 hits;
+    quint64 misses;
+
+    QImage loadFromSource(const Source &source);
+    void storeEncoded(int index, const QByteArray &data, const QImage &image);
+    static int costOf(const QImage &image);
+};
+
+#endif // TILEPIXELPOOL_H
@@ -21,78 +21,264 @@
 #include "mainwindow.h"
 
 #include <QDir>
+#include <QFile>
 #include <QProgressDialog>
-#include <QSet>
 #include <QHash>
+#include <QSet>
+#include <QCryptographicHash>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 #include <iostream>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
 
 const double TileStore::QUALITY_THRESHOLD = 0.45;
+const int TileStore::LOAD_BATCH_SIZE = 1024;
+const int TileStore::HASH_BYTES = 16;
 
 TileStore::TileStore() :
-    tileSize(0)
+    tileSize(0),
+    atlas(this),
+    mipmaps(this)
 {
+    connect(&mipmaps, SIGNAL(mipmapsReady()), this, SIGNAL(mipmapsReady()));
 }
 
 TileStore::TileStore(QImage tileImage, int tileSize) :
-    tileSize(tileSize)
+    tileSize(tileSize),
+    atlas(this),
+    mipmaps(this)
 {
+    connect(&mipmaps, SIGNAL(mipmapsReady()), this, SIGNAL(mipmapsReady()));
     const int numRows = tileImage.height()/tileSize;
     const int numCols = tileImage.width()/tileSize;
     for (int row = 0; row < numRows; ++row) {
         for (int col = 0; col < numCols; ++col) {
-            store.append(Tile(tileImage.copy(col*tileSize, row*tileSize, tileSize, tileSize), false, false));
+            Tile t(tileImage.copy(col*tileSize, row*tileSize, tileSize, tileSize), false, false, Tile::g_edgeMetric);
+            pixels.append(t.getImage(), QString(), -1);
+            tileHashes.append(imageHash(t.getImage()));
+            t.dropImage();
+            store.append(t);
             useCounts.append(0);
         }
     }
+    rebuildFlags();
+    atlas.reset();
+    mipmaps.reset();
+    edgeIndex.rebuild(store);
 }
 
 QString TileStore::loadTiles(QString dir)
 {
+    clear();
+    return appendTiles(dir);
+}
+
+void TileStore::clear()
+{
+    // Join the mipmap worker before the pixels it reads go away
+    mipmaps.reset();
     store.clear();
     useCounts.clear();
+    pixels.clear();
+    sources.clear();
+    sourceFirst.clear();
+    tileHashes.clear();
+    hashCounts.clear();
+    rebuildFlags();
     tileSize = 0;
+    atlas.reset();
+    edgeIndex.rebuild(store);
+}
+
+TileStore::CacheTile TileStore::readCacheTile(const QString &path, Tile::EdgeMetric metric)
+{
+    CacheTile cacheTile;
+    cacheTile.path = path;
+    cacheTile.tile = Tile(path, metric);
+    if (!cacheTile.tile.isNull()) {
+        cacheTile.hash = imageHash(cacheTile.tile.getImage());
+    }
+    return cacheTile;
+}
+
+int TileStore::ingestTiles(const QString &dir, QVector<CacheTile> &tiles, int *numRejected)
+{
+    const int first = store.size();
+    for (int i = 0; i < tiles.size(); ++i) {
+        if (!addCacheTile(tiles[i])) {
+            *numRejected += 1;
+        }
+    }
+    if (store.size() == first) {
+        return 0;
+    }
+    if (sources.isEmpty() || sources.last() != dir) {
+        sources.append(dir);
+        sourceFirst.append(first);
+    }
+    tilesAppended(first);
+    return store.size() - first;
+}
+
+int TileStore::removeTiles(const QVector<int> &indices)
+{
+    QVector<int> removed;
+    QSet<QByteArray> orphaned;
+    foreach (int index, indices) {
+        Tile &t = store[index];
+        if (t.isRemoved || useCounts.at(index) > 0) {
+            continue;
+        }
+        t.isRemoved = true;
+        // A later copy of the same pixels is no longer a duplicate
+        const QByteArray &hash = tileHashes.at(index);
+        if (--hashCounts[hash] > 0 && !t.isDuplicate) {
+            orphaned.insert(hash);
+        }
+        edgeIndex.remove(index, t);
+        if (t.kind == Tile::Solid) {
+            solidTiles[t.solidColor].removeOne(index);
+        }
+        setFlag(index, Removed, true);
+        removed.append(index);
+    }
+    // The first remaining copy takes over from a removed original
+    for (int i = 0; i < store.size() && !orphaned.isEmpty(); ++i) {
+        Tile &t = store[i];
+        if (t.isRemoved || !orphaned.contains(tileHashes.at(i))) {
+            continue;
+        }
+        orphaned.remove(tileHashes.at(i));
+        t.isDuplicate = false;
+        setFlag(i, Duplicate, false);
+    }
+    if (!removed.isEmpty()) {
+        std::sort(removed.begin(), removed.end());
+        emit tilesRemoved(removed);
+    }
+    return removed.size();
+}
+
+bool TileStore::isRemoved(int index) const
+{
+    return flagBits[Removed].test(index);
+}
+
+int TileStore::numRemoved() const
+{
+    return flagBits[Removed].count();
+}
+
+bool TileStore::addCacheTile(TileStore::CacheTile &cacheTile)
+{
+    Tile &t = cacheTile.tile;
+    if (t.isNull() || (tileSize != 0 && tileSize != t.size)) {
+        return false;
+    }
+    // The metric may have changed while the tile was read
+    if (t.getEdgeMetric() != Tile::g_edgeMetric) {
+        t = Tile(t.getImage(), t.isResized, false, Tile::g_edgeMetric);
+    }
+    tileSize = t.size;
+    // Duplicates are detected across all sources
+    int &count = hashCounts[cacheTile.hash];
+    t.isDuplicate = (count > 0);
+    count++;
+    tileHashes.append(cacheTile.hash);
+    pixels.append(t.getImage(), cacheTile.path, -1);
+    t.dropImage();
+    store.append(t);
+    useCounts.append(0);
+    return true;
+}
+
+void TileStore::tilesAppended(int first)
+{
+    for (int flag = 0; flag < NUM_FLAGS; ++flag) {
+        flagBits[flag].resize(store.size());
+    }
+    for (int i = first; i < store.size(); ++i) {
+        const Tile &t = store.at(i);
+        flagBits[Duplicate].set(i, t.isDuplicate);
+        flagBits[Resized].set(i, t.isResized);
+        flagBits[Solid].set(i, t.kind == Tile::Solid);
+        flagBits[Removed].set(i, false);
+        if (t.kind == Tile::Solid) {
+            solidTiles[t.solidColor].append(i);
+        }
+        edgeIndex.append(i, t);
+    }
+    updateVisibility();
+    // The atlas is laid out for the tile size, which is known now
+    if (first == 0) {
+        atlas.reset();
+    }
+    emit tilesInserted(first, store.size() - 1);
+}
+
+QString TileStore::appendTiles(QString dir)
+{
     QDir tileDir(dir);
     QStringList images = tileDir.entryList(QStringList() << "*.bmp", QDir::Files, QDir::Name);
     if (images.isEmpty()) {
         return "No .bmp image files to read!";
     }
+    const int first = store.size();
     int numSuccess = 0;
     int numFailures = 0;
     int numResized = 0;
     int numDuplicates = 0;
+    bool cancelled = false;
     QProgressDialog pd("Training AI and building blockchain...", "Cancel", 0, images.size());
     pd.setWindowModality(Qt::WindowModal);
     pd.setMinimumDuration(0);
-    QSet<uint> imageHashes;
-    foreach(QString name, images) {
-        pd.setValue(pd.value() + 1);
-        QString path = dir + QDir::separator() + name;
-        Tile t(path);
-        if (t.isNull() || (tileSize != 0 && tileSize != t.size)) {
-            numFailures++;
-        } else {
+    // Batches bound the number of decoded images held at once
+    for (int batchStart = 0; batchStart < images.size(); batchStart += LOAD_BATCH_SIZE) {
+        pd.setValue(batchStart);
+        if (pd.wasCanceled()) {
+            cancelled = true;
+            break;
+        }
+        // Parallel stage: read images and compute features
+        QVector<CacheTile> batch(qMin(LOAD_BATCH_SIZE, images.size() - batchStart));
+        for (int i = 0; i < batch.size(); ++i) {
+            batch[i].path = dir + QDir::separator() + images.at(batchStart + i);
+        }
+        const Tile::EdgeMetric metric = Tile::g_edgeMetric;
+        QtConcurrent::blockingMap(batch, [metric](CacheTile &cacheTile) {
+            cacheTile = readCacheTile(cacheTile.path, metric);
+        });
+        // Sequential stage in file name order: check size and duplicates
+        for (int i = 0; i < batch.size(); ++i) {
+            CacheTile &cacheTile = batch[i];
+            if (!addCacheTile(cacheTile)) {
+                numFailures++;
+                continue;
+            }
             numSuccess++;
-            if (t.isResized) {
+            if (cacheTile.tile.isResized) {
                 numResized++;
             }
-            tileSize = t.size;
-            useCounts.append(0);
-            // Check for duplicate
-            uint hash = qHashBits(t.getImage().constBits(), t.getImage().byteCount());
-            if (imageHashes.contains(hash)) {
-                t.isDuplicate = true;
+            if (cacheTile.tile.isDuplicate) {
                 numDuplicates++;
-            } else {
-                imageHashes.insert(hash);
             }
-            store.append(t);
         }
     }
+    pd.reset();
+    if (store.size() > first) {
+        sources.append(dir);
+        sourceFirst.append(first);
+        tilesAppended(first);
+    }
     MainWindow::displayMessage(
                 QString("Loaded ") + QString::number(numSuccess) + " tiles ("
                 + QString::number(numDuplicates) + " duplicates and "
                 + QString::number(numResized) + " non-square).\n" +
-                QString::number(numFailures) + " tiles failed to load.");
+                QString::number(numFailures) + " tiles failed to load."
+                + (cancelled ? "\nLoading was cancelled." : "")
+                + (sources.size() > 1 ? "\nThe case now has " + QString::number(sources.size()) + " sources." : ""));
     return "";
 }
 
@@ -106,6 +292,38 @@ Tile TileStore::getTile(int index)
     return store.at(index);
 }
 
+QImage TileStore::getImage(int index)
+{
+    return pixels.image(index);
+}
+
+void TileStore::drawTile(QPainter &painter, int x, int y, int index, bool faded)
+{
+    atlas.draw(painter, x, y, index, faded);
+}
+
+void TileStore::drawTile(QPainter &painter, const QRect &target, int index, bool faded)
+{
+    if (target.width() == tileSize && target.height() == tileSize) {
+        atlas.draw(painter, target.x(), target.y(), index, faded);
+        return;
+    }
+    if (!faded) {
+        for (int level = 1; level <= TileMipmaps::MAX_LEVEL; ++level) {
+            if (target.width() == (tileSize >> level)) {
+                const QImage mipmap = mipmaps.image(index, level);
+                if (!mipmap.isNull()) {
+                    painter.drawImage(target.topLeft(), mipmap);
+                    return;
+                }
+                break;
+            }
+        }
+    }
+    // Scale on the fly until the mipmap has been generated
+    atlas.draw(painter, target, index, faded);
+}
+
 QString TileStore::saveData(QDataStream &out)
 {
     out << (qint32)tileSize;
@@ -113,9 +331,11 @@ QString TileStore::saveData(QDataStream &out)
     QProgressDialog pd("Saving case data...", "Cancel", 0, store.size());
     pd.setWindowModality(Qt::WindowModal);
     pd.setMinimumDuration(0);
+    savedOffsets.clear();
     for (int i = 0; i < store.size(); ++i) {
         pd.setValue(i);
-        out << store.at(i).getImage();
+        savedOffsets.append(out.device()->pos());
+        out << getImage(i);
         out << (bool)(store.at(i).isResized);
         out << (bool)(store.at(i).isDuplicate);
         if (pd.wasCanceled()) {
@@ -123,38 +343,285 @@ QString TileStore::saveData(QDataStream &out)
         }
     }
     out << useCounts;
+    out << sources;
+    out << sourceFirst;
+    QVector<qint32> removedTiles;
+    for (int i = flagBits[Removed].next(0); i != -1; i = flagBits[Removed].next(i + 1)) {
+        removedTiles.append(i);
+    }
+    out << removedTiles;
     return "";
 }
 
-QString TileStore::loadData(QDataStream &in)
+//
+// Read a QImage serialized by QDataStream (null marker plus PNG data) without
+// decoding it. Returns false on a read error; data stays empty for null images.
+//
+static bool readRawImage(QDataStream &in, QByteArray *data)
 {
+    qint32 nullMarker;
+    in >> nullMarker;
+    if (!nullMarker) {
+        return in.status() == QDataStream::Ok;
+    }
+    // PNG signature, then chunks until IEND
+    data->resize(8);
+    if (in.readRawData(data->data(), 8) != 8) {
+        return false;
+    }
+    forever {
+        char chunkHeader[8];
+        if (in.readRawData(chunkHeader, 8) != 8) {
+            return false;
+        }
+        const quint32 length = (quint32(uchar(chunkHeader[0])) << 24) | (quint32(uchar(chunkHeader[1])) << 16)
+                | (quint32(uchar(chunkHeader[2])) << 8) | quint32(uchar(chunkHeader[3]));
+        const int pos = data->size();
+        data->resize(pos + 8 + int(length) + 4);
+        memcpy(data->data() + pos, chunkHeader, 8);
+        if (in.readRawData(data->data() + pos + 8, int(length) + 4) != int(length) + 4) {
+            return false;
+        }
+        if (memcmp(chunkHeader + 4, "IEND", 4) == 0) {
+            return true;
+        }
+    }
+}
+
+QString TileStore::loadData(QDataStream &in, quint32 version)
+{
+    // Every failure below clears the store again, so the pixel pool, atlas
+    // and mipmaps never describe tiles the store does not have
+    clear();
     qint32 in_tileSize;
     in >> in_tileSize;
     tileSize = (int)in_tileSize;
     qint32 in_size;
     in >> in_size;
-    store.clear();
+    // Tile pixels are paged from the case file itself
+    QFile *caseFile = qobject_cast<QFile *>(in.device());
+    const QString caseFilename = (caseFile != NULL) ? caseFile->fileName() : QString();
+    // Sequential stage: only read raw image data
+    QVector<CaseTile> caseTiles(in_size);
     QProgressDialog pd("Loading case data...", "Cancel", 0, in_size);
     pd.setWindowModality(Qt::WindowModal);
     pd.setMinimumDuration(0);
     for (int i = 0; i < in_size; ++i) {
         pd.setValue(i);
-        QImage image;
-        in >> image;
-        bool isResized;
-        in >> isResized;
-        bool isDuplicate;
-        in >> isDuplicate;
-        store.append(Tile(image, isResized, isDuplicate));
+        CaseTile &caseTile = caseTiles[i];
+        caseTile.index = i;
+        const qint64 offset = in.device()->pos();
+        if (!readRawImage(in, &caseTile.imageData)) {
+            clear();
+            return "Corrupt tile data!";
+        }
+        in >> caseTile.isResized;
+        in >> caseTile.isDuplicate;
+        pixels.append(QImage(), caseFilename, offset);
         if (pd.wasCanceled()) {
-            return "Camcelled";
+            clear();
+            return "Cancelled";
         }
     }
+    pd.reset();
+    // Parallel stage: decode images and compute features, tile indices stay as they are
+    QFutureWatcher<void> watcher;
+    const Tile::EdgeMetric metric = Tile::g_edgeMetric;
+    watcher.setFuture(QtConcurrent::map(caseTiles, [this, metric](CaseTile &caseTile) {
+        QImage image = QImage::fromData(caseTile.imageData, "PNG");
+        caseTile.imageData.clear();
+        caseTile.tile = Tile(image, caseTile.isResized, caseTile.isDuplicate, metric);
+        caseTile.tile.dropImage();
+        caseTile.hash = imageHash(image);
+        pixels.prime(caseTile.index, image);
+    }));
+    if (!MainWindow::runWithProgress("Decoding tiles...", watcher)) {
+        clear();
+        return "Cancelled";
+    }
+    for (int i = 0; i < caseTiles.size(); ++i) {
+        store.append(caseTiles.at(i).tile);
+        tileHashes.append(caseTiles.at(i).hash);
+    }
     useCounts.clear();
     in >> useCounts;
+    // Older case files have a single source
+    if (version >= 4) {
+        in >> sources;
+        in >> sourceFirst;
+    } else if (!store.isEmpty()) {
+        sources.append(caseFilename);
+        sourceFirst.append(0);
+    }
+    QVector<qint32> removedTiles;
+    if (version >= 5) {
+        in >> removedTiles;
+    }
+    bool removedValid = true;
+    foreach (qint32 index, removedTiles) {
+        if (index < 0 || index >= store.size()) {
+            removedValid = false;
+            break;
+        }
+        store[index].isRemoved = true;
+    }
+    bool sourcesValid = (sources.size() == sourceFirst.size())
+            && (sourceFirst.isEmpty() || sourceFirst.first() == 0);
+    for (int i = 1; sourcesValid && i < sourceFirst.size(); ++i) {
+        sourcesValid = sourceFirst.at(i) > sourceFirst.at(i - 1) && sourceFirst.at(i) < store.size();
+    }
+    if (useCounts.size() != store.size() || !sourcesValid || !removedValid) {
+        clear();
+        return "Corrupt tile data!";
+    }
+    for (int i = 0; i < store.size(); ++i) {
+        if (!store.at(i).isRemoved) {
+            hashCounts[tileHashes.at(i)]++;
+        }
+    }
+    rebuildFlags();
+    atlas.reset();
+    mipmaps.reset();
+    edgeIndex.rebuild(store);
     return "";
 }
 
+void TileStore::rebindPixels(QString caseFilename)
+{
+    Q_ASSERT(savedOffsets.size() == store.size());
+    for (int i = 0; i < savedOffsets.size(); ++i) {
+        pixels.setSource(i, caseFilename, savedOffsets.at(i));
+    }
+}
+
+void TileStore::setPixelMemoryLimit(int megabytes)
+{
+    pixels.setMemoryLimit(megabytes);
+}
+
+int TileStore::getPixelMemoryLimit()
+{
+    return pixels.getMemoryLimit();
+}
+
+void TileStore::setCompactPixels(bool enable)
+{
+    pixels.setCompactEncoding(enable);
+}
+
+bool TileStore::getCompactPixels()
+{
+    return pixels.getCompactEncoding();
+}
+
+bool TileStore::setEdgeMetric(Tile::EdgeMetric metric)
+{
+    if (metric == Tile::g_edgeMetric) {
+        return true;
+    }
+    QVector<Tile> tiles = store.toVector();
+    const Tile *first = tiles.data();
+    QFutureWatcher<void> watcher;
+    watcher.setFuture(QtConcurrent::map(tiles, [this, first, metric](Tile &tile) {
+        const int index = int(&tile - first);
+        // Only the features are recomputed, the store state of the tile stays
+        Tile updated(pixels.image(index), tile.isResized, tile.isDuplicate, metric);
+        updated.isRemoved = tile.isRemoved;
+        updated.dropImage();
+        tile = updated;
+    }));
+    if (!MainWindow::runWithProgress("Computing edge profiles...", watcher)) {
+        return false;
+    }
+    Tile::g_edgeMetric = metric;
+    for (int i = 0; i < tiles.size(); ++i) {
+        store[i] = tiles.at(i);
+    }
+    emit availableTilesChanged();
+    return true;
+}
+
+QVector<int> TileStore::continuations(int index, Tile::Edge edge, EdgeIndex::Precision precision) const
+{
+    return edgeIndex.continuations(store.at(index), edge, precision, store);
+}
+
+int TileStore::numSources() const
+{
+    return sources.size();
+}
+
+QString TileStore::sourceName(int source) const
+{
+    return sources.value(source);
+}
+
+int TileStore::sourceOf(int index) const
+{
+    return sourceOf(index, sourceFirst);
+}
+
+int TileStore::sourceOf(int index, const QVector<qint32> &sourceStarts)
+{
+    // Index of the last source starting at or before index
+    return int(std::upper_bound(sourceStarts.constBegin(), sourceStarts.constEnd(), index) - sourceStarts.constBegin()) - 1;
+}
+
+QVector<int> TileStore::sourceTiles(int source) const
+{
+    const int first = sourceFirst.at(source);
+    const int end = (source + 1 < sourceFirst.size()) ? sourceFirst.at(source + 1) : store.size();
+    QVector<int> result;
+    result.reserve(end - first);
+    for (int i = first; i < end; ++i) {
+        result.append(i);
+    }
+    return result;
+}
+
+int TileStore::storeDistance(int index, int otherIndex) const
+{
+    return storeDistance(index, otherIndex, sourceFirst);
+}
+
+int TileStore::storeDistance(int index, int otherIndex, const QVector<qint32> &sourceStarts)
+{
+    if (sourceOf(index, sourceStarts) != sourceOf(otherIndex, sourceStarts)) {
+        return INT_MAX;
+    }
+    return abs(index - otherIndex);
+}
+
+QVector<qint32> TileStore::sourceStarts() const
+{
+    return sourceFirst;
+}
+
+QByteArray TileStore::imageHash(const QImage &image)
+{
+    // Tiles of different sources may have been decoded to different formats
+    const QImage normalized = (image.format() == QImage::Format_RGB32) ? image : image.convertToFormat(QImage::Format_RGB32);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(reinterpret_cast<const char *>(normalized.constBits()), normalized.byteCount());
+    return hash.result().left(HASH_BYTES);
+}
+
+QString TileStore::memoryReport()
+{
+    qint64 featureBytes = 0;
+    for (int i = 0; i < store.size(); ++i) {
+        featureBytes += store.at(i).featureBytes();
+    }
+    return pixels.report() + "\n" + atlas.report() + "\n"
+            + "Tiles with mipmaps: " + QString::number(mipmaps.size()) + "\n"
+            + edgeIndex.report() + "\n"
+            + "Removed tiles: " + QString::number(numRemoved()) + "\n"
+            + "Solid tiles: " + QString::number(flagBits[Solid].count()) + " in "
+            + QString::number(solidTiles.size()) + " colors\n"
+            + "Edge profiles: " + QString::number(featureBytes/1024) + " KB ("
+            + (Tile::g_edgeMetric == Tile::Sad ? "8 bit" : "floating point") + ")";
+}
+
 int TileStore::getUseCount(int index)
 {
     return useCounts.at(index);
@@ -162,7 +629,24 @@ int TileStore::getUseCount(int index)
 
 void TileStore::incUseCount(int index)
 {
-    useCounts.replace(index, useCounts.at(index) + 1);
+    const int count = useCounts.at(index) + 1;
+    useCounts.replace(index, count);
+    if (count == 1) {
+        setFlag(index, Used, true);
+    }
+    emit useCountsChanged(QVector<int>() << index);
+}
+
+void TileStore::incUseCounts(const QVector<int> &indices)
+{
+    foreach (int index, indices) {
+        const int count = useCounts.at(index) + 1;
+        useCounts.replace(index, count);
+        if (count == 1) {
+            setFlag(index, Used, true);
+        }
+    }
+    emit useCountsChanged(indices);
 }
 
 void TileStore::decUseCount(int index)
@@ -170,37 +654,178 @@ void TileStore::decUseCount(int index)
     int count = useCounts.at(index);
     useCounts.replace(index, count - 1);
     Q_ASSERT(count - 1 >= 0);
+    if (count == 1) {
+        setFlag(index, Used, false);
+    }
+    emit useCountsChanged(QVector<int>() << index);
+}
+
+bool TileStore::isHidden(int index) const
+{
+    return !visible.test(index);
+}
+
+int TileStore::nextVisible(int index) const
+{
+    return visible.next(index);
+}
+
+int TileStore::numVisible() const
+{
+    return visible.count();
+}
+
+int TileStore::visiblePosition(int index) const
+{
+    return visible.rank(index);
 }
 
-bool TileStore::isHidden(int index)
+int TileStore::visibleTile(int position) const
 {
-    Tile t = getTile(index);
-    return (
-                (hideDuplicates && t.isDuplicate)
-                || (hideNonSquare && t.isResized)
-                || (hideUsed && useCounts.at(index) > 0)
-                );
+    return visible.select(position);
+}
+
+QByteArray TileStore::getTileHash(int index) const
+{
+    return tileHashes.value(index);
+}
+
+bool TileStore::isSolid(int index) const
+{
+    return flagBits[Solid].test(index);
+}
+
+int TileStore::solidRepresentative(QRgb color) const
+{
+    foreach (int index, solidTiles.value(color)) {
+        if (visible.test(index)) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+QVector<int> TileStore::solidRepresentatives() const
+{
+    QVector<int> result;
+    for (auto it = solidTiles.constBegin(); it != solidTiles.constEnd(); ++it) {
+        const int index = solidRepresentative(it.key());
+        if (index != -1) {
+            result.append(index);
+        }
+    }
+    return result;
+}
+
+QVector<int> TileStore::candidates() const
+{
+    // Solid tiles of one color score alike, so only one of them is scored
+    QVector<int> result = solidRepresentatives();
+    for (int i = visible.next(0); i != -1; i = visible.next(i + 1)) {
+        if (!flagBits[Solid].test(i)) {
+            result.append(i);
+        }
+    }
+    return result;
+}
+
+bool TileStore::isCandidate(int index) const
+{
+    if (!visible.test(index)) {
+        return false;
+    }
+    return !flagBits[Solid].test(index) || solidRepresentative(store.at(index).solidColor) == index;
 }
 
 void TileStore::hideUsedChanged(int state)
 {
-    hideUsed = (state == Qt::Checked);
-    emit availableTilesChanged();
+    setFlagHidden(Used, state == Qt::Checked);
 }
 
 void TileStore::hideDuplicatesChanged(int state)
 {
-    hideDuplicates = (state == Qt::Checked);
-    emit availableTilesChanged();
+    setFlagHidden(Duplicate, state == Qt::Checked);
 }
 
 void TileStore::hideNonSquareChanged(int state)
 {
-    hideNonSquare = (state == Qt::Checked);
-    emit availableTilesChanged();
+    setFlagHidden(Resized, state == Qt::Checked);
+}
+
+void TileStore::hideSolidChanged(int state)
+{
+    setFlagHidden(Solid, state == Qt::Checked);
 }
 
 bool TileStore::getHideUsed() const
 {
-    return hideUsed;
+    return hiddenFlags & (1 << Used);
+}
+
+void TileStore::rebuildFlags()
+{
+    for (int flag = 0; flag < NUM_FLAGS; ++flag) {
+        flagBits[flag].resize(store.size());
+        flagBits[flag].fill(false);
+    }
+    for (int i = 0; i < store.size(); ++i) {
+        const Tile &t = store.at(i);
+        flagBits[Duplicate].set(i, t.isDuplicate);
+        flagBits[Resized].set(i, t.isResized);
+        flagBits[Used].set(i, useCounts.at(i) > 0);
+        flagBits[Solid].set(i, t.kind == Tile::Solid);
+        flagBits[Removed].set(i, t.isRemoved);
+    }
+    solidTiles.clear();
+    for (int i = flagBits[Solid].next(0); i != -1; i = flagBits[Solid].next(i + 1)) {
+        if (!store.at(i).isRemoved) {
+            solidTiles[store.at(i).solidColor].append(i);
+        }
+    }
+    updateVisibility();
+}
+
+void TileStore::setFlag(int index, Flag flag, bool value)
+{
+    flagBits[flag].set(index, value);
+    if (!(hiddenFlags & (1 << flag))) {
+        return;
+    }
+    bool isVisible = true;
+    for (int f = 0; f < NUM_FLAGS; ++f) {
+        if ((hiddenFlags & (1 << f)) && flagBits[f].test(index)) {
+            isVisible = false;
+        }
+    }
+    if (isVisible != visible.test(index)) {
+        visible.set(index, isVisible);
+        emit visibilityChanged(index);
+    }
+}
+
+void TileStore::setFlagHidden(Flag flag, bool hidden)
+{
+    if (hidden) {
+        hiddenFlags |= (1 << flag);
+    } else {
+        hiddenFlags &= ~(1 << flag);
+    }
+    updateVisibility();
+    emit availableTilesChanged();
+}
+
+void TileStore::updateVisibility()
+{
+    visible.resize(store.size());
+    quint64 *words = visible.wordsForWriting();
+    for (int w = 0; w < visible.numWords(); ++w) {
+        quint64 hidden = 0;
+        for (int flag = 0; flag < NUM_FLAGS; ++flag) {
+            if (hiddenFlags & (1 << flag)) {
+                hidden |= flagBits[flag].constWords()[w];
+            }
+        }
+        words[w] = ~hidden;
+    }
+    visible.clearTail();
 }
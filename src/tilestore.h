@@ -22,16 +22,40 @@
 
 #include <QList>
 #include <QVector>
+#include <QHash>
+#include <QStringList>
 
 #include "tile.h"
+#include "tilepixelpool.h"
+#include "tilebitset.h"
+#include "tileatlas.h"
+#include "tilemipmaps.h"
+#include "edgeindex.h"
 
 class TileStore : public QObject
 {
     Q_OBJECT
 
 public:
+    //
+    // A tile read from a cache file, with features but not yet in the store
+    //
+    struct CacheTile {
+        QString path;
+        Tile tile;
+        QByteArray hash;
+    };
+
     static const double QUALITY_THRESHOLD;
     //
+    // Number of cache files decoded at once when loading
+    //
+    static const int LOAD_BATCH_SIZE;
+    //
+    // Per-tile flags that can be used to hide tiles
+    //
+    enum Flag {Duplicate, Resized, Used, Solid, Removed, NUM_FLAGS};
+    //
     // Size (width and height) of the tiles in the store.
     // All tiles in the store must have the same size. Tiles
     // with a different size than the first one seen are ignored.
@@ -43,14 +67,125 @@ public:
     TileStore(QImage tileImage, int tileSize);
 
     QString loadTiles(QString dir);
+    //
+    // Remove all tiles and sources
+    //
+    void clear();
+    //
+    // Add the tiles of another cache directory as a new source. Tiles keep
+    // their indices; duplicates are detected across all sources. The start
+    // screen store has no sources.
+    //
+    QString appendTiles(QString dir);
+    int numSources() const;
+    QString sourceName(int source) const;
+    int sourceOf(int index) const;
+    //
+    // Distance of two tiles in the store, INT_MAX if they come from
+    // different sources
+    //
+    int storeDistance(int index, int otherIndex) const;
+    //
+    // Same for a snapshot of sourceStarts, for use in worker threads
+    //
+    static int storeDistance(int index, int otherIndex, const QVector<qint32> &sourceStarts);
+    QVector<qint32> sourceStarts() const;
+    //
+    // Indices of the tiles loaded from a source, including removed ones
+    //
+    QVector<int> sourceTiles(int source) const;
+    //
+    // Read a cache file and compute its features for the given metric;
+    // thread-safe. The tile is null if the file could not be read.
+    //
+    static CacheTile readCacheTile(const QString &path, Tile::EdgeMetric metric);
+    //
+    // Add tiles read in the background to the last source if it is dir, or
+    // to a new source. Tiles read for another edge metric than the current
+    // one are recomputed. Returns the number of tiles added; rejected tiles
+    // (wrong size) are counted in *numRejected.
+    //
+    int ingestTiles(const QString &dir, QVector<CacheTile> &tiles, int *numRejected);
+    //
+    // Remove tiles from the store without renumbering the others. Tiles
+    // placed on a screen are kept. Returns the number of removed tiles.
+    //
+    int removeTiles(const QVector<int> &indices);
+    bool isRemoved(int index) const;
+    int numRemoved() const;
     int size() const;
     Tile getTile(int index);
+    //
+    // Pixel digest of a tile
+    //
+    QByteArray getTileHash(int index) const;
+    //
+    // Pixel data of a tile, paged in from disk if necessary; thread-safe
+    //
+    QImage getImage(int index);
+    //
+    // Draw a tile from the atlas, optionally faded like used tiles in the store
+    //
+    void drawTile(QPainter &painter, int x, int y, int index, bool faded = false);
+    //
+    // Draw a tile scaled to the target, using a mipmap if the target size is
+    // the tile size divided by a power of two and the mipmap is available
+    //
+    void drawTile(QPainter &painter, const QRect &target, int index, bool faded = false);
     QString saveData(QDataStream &out);
-    QString loadData(QDataStream &in);
+    QString loadData(QDataStream &in, quint32 version);
+    //
+    // Page tile pixels from the given case file after it has been written
+    // successfully by saveData
+    //
+    void rebindPixels(QString caseFilename);
+    void setPixelMemoryLimit(int megabytes);
+    int getPixelMemoryLimit();
+    //
+    // Keep tile pixels palette-indexed or run-length encoded in memory
+    //
+    void setCompactPixels(bool enable);
+    bool getCompactPixels();
+    //
+    // Recompute the edge profiles of all tiles for the given metric. Returns
+    // false if cancelled, leaving the previous metric in place.
+    //
+    bool setEdgeMetric(Tile::EdgeMetric metric);
+    QString memoryReport();
     int getUseCount(int index);
     void incUseCount(int index);
+    //
+    // Increment the use count of several tiles with a single notification
+    //
+    void incUseCounts(const QVector<int> &indices);
     void decUseCount(int index);
-    bool isHidden(int index);
+    bool isHidden(int index) const;
+    //
+    // Visible tiles in index order. nextVisible returns the first visible
+    // index >= index, or -1 if there is none. visiblePosition of a hidden
+    // tile is the position it would have if it were visible.
+    //
+    int nextVisible(int index) const;
+    int numVisible() const;
+    int visiblePosition(int index) const;
+    int visibleTile(int position) const;
+    //
+    // Tiles whose opposite edge continues the given edge of a tile, looked
+    // up by boundary hash instead of scoring the whole store
+    //
+    QVector<int> continuations(int index, Tile::Edge edge, EdgeIndex::Precision precision) const;
+    bool isSolid(int index) const;
+    //
+    // Solid tiles are scored through one visible representative per color.
+    // solidRepresentative returns -1 if no tile of the color is visible.
+    //
+    int solidRepresentative(QRgb color) const;
+    QVector<int> solidRepresentatives() const;
+    //
+    // Visible tiles to be scored, with one representative per solid color
+    //
+    QVector<int> candidates() const;
+    bool isCandidate(int index) const;
     bool isGoodMatch(double score);
     bool getHideUsed() const;
 
@@ -58,16 +193,85 @@ public slots:
     void hideUsedChanged(int state);
     void hideDuplicatesChanged(int state);
     void hideNonSquareChanged(int state);
+    void hideSolidChanged(int state);
 
 signals:
     void availableTilesChanged();
+    //
+    // Tiles [first, last] have been appended
+    //
+    void tilesInserted(int first, int last);
+    //
+    // Tile indices in ascending order
+    //
+    void tilesRemoved(const QVector<int> &indices);
+    void useCountsChanged(const QVector<int> &indices);
+    void visibilityChanged(int index);
+    void mipmapsReady();
 
 private:
+    //
+    // Intermediate state of a tile while a case file is loaded
+    //
+    struct CaseTile {
+        int index = 0;
+        QByteArray imageData;
+        bool isResized = false;
+        bool isDuplicate = false;
+        Tile tile;
+        QByteArray hash;
+    };
     QList<Tile> store;
     QList<int> useCounts;
-    bool hideUsed = false;
-    bool hideDuplicates = true;
-    bool hideNonSquare = false;
+    TilePixelPool pixels;
+    TileAtlas atlas;
+    TileMipmaps mipmaps;
+    EdgeIndex edgeIndex;
+    //
+    // Stream offsets of tile images written by the last saveData
+    //
+    QVector<qint64> savedOffsets;
+    TileBitset flagBits[NUM_FLAGS];
+    TileBitset visible;
+    //
+    // Cache directories the tiles were loaded from, with the index of
+    // their first tile
+    //
+    QStringList sources;
+    QVector<qint32> sourceFirst;
+    //
+    // Pixel digest of each tile, and the number of tiles not removed per
+    // digest for duplicate detection. The digest is 128 bits wide, so a
+    // collision between distinct tiles is not a practical concern even for
+    // very large stores.
+    //
+    static const int HASH_BYTES;
+    QVector<QByteArray> tileHashes;
+    QHash<QByteArray, int> hashCounts;
+    //
+    // Indices of solid tiles by color
+    //
+    QHash<QRgb, QVector<int>> solidTiles;
+    //
+    // Bit mask of flags that hide a tile
+    //
+    quint32 hiddenFlags = (1 << Duplicate) | (1 << Removed);
+
+    void rebuildFlags();
+    static int sourceOf(int index, const QVector<qint32> &sourceStarts);
+    //
+    // Sequential part of adding a loaded tile: check its size and whether it
+    // is a duplicate. Returns false if the tile does not fit the store.
+    //
+    bool addCacheTile(CacheTile &cacheTile);
+    //
+    // Update flags and indexes for tiles appended from first on
+    //
+    void tilesAppended(int first);
+    static QByteArray imageHash(const QImage &image);
+    void setFlag(int index, Flag flag, bool value);
+    void setFlagHidden(Flag flag, bool hidden);
+    void updateVisibility();
 };
 
 #endif // TILESTORE_H
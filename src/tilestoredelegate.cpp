@@ -0,0 +1,53 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tilestoredelegate.h"
+
+#include <QPainter>
+
+#include "tilestoremodel.h"
+
+const int TileStoreDelegate::TILE_MARGIN = 6;
+
+TileStoreDelegate::TileStoreDelegate(TileStore *tileStore, QObject *parent)
+    : QStyledItemDelegate(parent),
+      tileStore(tileStore)
+{
+}
+
+void TileStoreDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const QVariant tileIndex = index.data(TileStoreModel::TileIndexRole);
+    if (!tileIndex.isValid()) {
+        return;
+    }
+    if (option.state & QStyle::State_Selected) {
+        painter->fillRect(option.rect, option.palette.highlight());
+    }
+    const int x = option.rect.x() + (option.rect.width() - tileStore->tileSize)/2;
+    const int y = option.rect.y() + (option.rect.height() - tileStore->tileSize)/2;
+    tileStore->drawTile(*painter, x, y, tileIndex.toInt(), index.data(TileStoreModel::UsedRole).toBool());
+}
+
+QSize TileStoreDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    Q_UNUSED(option);
+    Q_UNUSED(index);
+    return QSize(tileStore->tileSize + TILE_MARGIN, tileStore->tileSize + TILE_MARGIN);
+}
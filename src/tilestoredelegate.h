@@ -0,0 +1,46 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILESTOREDELEGATE_H
+#define TILESTOREDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+#include "tilestore.h"
+
+//
+// Paints tiles of a TileStoreModel from the tile atlas of the store
+//
+class TileStoreDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    static const int TILE_MARGIN;
+
+    TileStoreDelegate(TileStore *tileStore, QObject *parent = 0);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+private:
+    TileStore *tileStore;
+};
+
+#endif // TILESTOREDELEGATE_H
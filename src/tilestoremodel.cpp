@@ -0,0 +1,168 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tilestoremodel.h"
+
+TileStoreModel::TileStoreModel(TileStore *tileStore, int width, QObject *parent)
+    : QAbstractTableModel(parent),
+      tileStore(tileStore),
+      width(width),
+      numRows(0)
+{
+    reset();
+}
+
+int TileStoreModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return numRows;
+}
+
+int TileStoreModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return width;
+}
+
+QVariant TileStoreModel::data(const QModelIndex &index, int role) const
+{
+    const int tile = tileIndex(index);
+    if (tile == -1) {
+        return QVariant();
+    }
+    switch (role) {
+    case TileIndexRole:
+        return tile;
+    case UsedRole:
+        return tileStore->getUseCount(tile) > 0;
+    case Qt::ToolTipRole:
+        return QString("Tile ") + QString::number(tile)
+                + (tileStore->numSources() > 1 ? " from " + tileStore->sourceName(tileStore->sourceOf(tile)) : QString())
+                + ", used "
+                + QString::number(tileStore->getUseCount(tile)) + " times";
+    default:
+        return QVariant();
+    }
+}
+
+Qt::ItemFlags TileStoreModel::flags(const QModelIndex &index) const
+{
+    if (tileIndex(index) == -1) {
+        return Qt::NoItemFlags;
+    }
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+int TileStoreModel::tileIndex(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return -1;
+    }
+    return tileStore->visibleTile(index.row()*width + index.column());
+}
+
+QModelIndex TileStoreModel::modelIndex(int tileIndex) const
+{
+    if (tileIndex < 0 || tileIndex >= tileStore->size() || tileStore->isHidden(tileIndex)) {
+        return QModelIndex();
+    }
+    const int pos = tileStore->visiblePosition(tileIndex);
+    return index(pos/width, pos%width);
+}
+
+void TileStoreModel::setWidth(int width)
+{
+    beginResetModel();
+    this->width = width;
+    numRows = rowsNeeded();
+    endResetModel();
+}
+
+void TileStoreModel::reset()
+{
+    beginResetModel();
+    numRows = rowsNeeded();
+    endResetModel();
+}
+
+void TileStoreModel::useCountChanged(int index)
+{
+    // Only the faded state changed
+    if (!tileStore->isHidden(index)) {
+        const int pos = tileStore->visiblePosition(index);
+        cellsChanged(pos, pos);
+    }
+}
+
+void TileStoreModel::visibilityChanged(int index)
+{
+    // All following tiles moved by one cell
+    const int lastPos = qMin(tileStore->numVisible(), rowCount()*width - 1);
+    cellsChanged(tileStore->visiblePosition(index), lastPos);
+}
+
+void TileStoreModel::tilesInserted(int first)
+{
+    const int rows = rowsNeeded();
+    if (rows > numRows) {
+        beginInsertRows(QModelIndex(), numRows, rows - 1);
+        numRows = rows;
+        endInsertRows();
+    }
+    // Appended tiles may also fill up the last existing row
+    if (first < tileStore->size()) {
+        const int lastPos = qMin(tileStore->numVisible(), numRows*width - 1);
+        cellsChanged(tileStore->visiblePosition(first), lastPos);
+    }
+}
+
+void TileStoreModel::tilesRemoved()
+{
+    const int rows = rowsNeeded();
+    if (rows < numRows) {
+        beginRemoveRows(QModelIndex(), rows, numRows - 1);
+        numRows = rows;
+        endRemoveRows();
+    }
+}
+
+int TileStoreModel::rowsNeeded() const
+{
+    // Leave room for all tiles, so showing hidden tiles does not change the layout.
+    // Removed tiles can never be shown again.
+    return (tileStore->size() - tileStore->numRemoved() + width - 1)/width;
+}
+
+void TileStoreModel::cellsChanged(int firstPos, int lastPos)
+{
+    if (firstPos > lastPos) {
+        return;
+    }
+    const int firstRow = firstPos/width;
+    const int lastRow = lastPos/width;
+    if (firstRow == lastRow) {
+        emit dataChanged(index(firstRow, firstPos%width), index(lastRow, lastPos%width));
+    } else {
+        emit dataChanged(index(firstRow, 0), index(lastRow, width - 1));
+    }
+}
@@ -0,0 +1,91 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILESTOREMODEL_H
+#define TILESTOREMODEL_H
+
+#include <QAbstractTableModel>
+
+#include "tilestore.h"
+
+//
+// Table model laying out the visible tiles of a store row by row. The
+// mapping between cells and tiles is maintained by the store itself.
+//
+class TileStoreModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    //
+    // Custom data roles
+    //
+    static const int TileIndexRole = Qt::UserRole;
+    static const int UsedRole = Qt::UserRole + 1;
+
+    TileStoreModel(TileStore *tileStore, int width, QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+    //
+    // Return tile index for a model index, or -1 if the cell is empty
+    //
+    int tileIndex(const QModelIndex &index) const;
+    //
+    // Return model index of a tile, or an invalid index if it is hidden
+    //
+    QModelIndex modelIndex(int tileIndex) const;
+    void setWidth(int width);
+
+public slots:
+    //
+    // Rebuild the complete layout
+    //
+    void reset();
+    //
+    // Update only cells affected by a changed use count or visibility
+    //
+    void useCountChanged(int index);
+    void visibilityChanged(int index);
+    //
+    // Add rows for tiles appended from first on
+    //
+    void tilesInserted(int first);
+    //
+    // Drop rows no longer needed after tiles have been removed
+    //
+    void tilesRemoved();
+
+private:
+    TileStore *tileStore;
+    int width;
+    //
+    // Row count as announced to views; the store may already be larger
+    //
+    int numRows;
+
+    int rowsNeeded() const;
+
+    void cellsChanged(int firstPos, int lastPos);
+};
+
+#endif // TILESTOREMODEL_H
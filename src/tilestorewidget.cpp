@@ -19,96 +19,109 @@
 
 #include "tilestorewidget.h"
 
-#include <QTableWidget>
 #include <QHeaderView>
-#include <iostream>
-#include <QPainter>
 
 #include "tilestore.h"
 
-const double TileStoreWidget::USED_TILE_OPACITY = 0.25;
-const int TileStoreWidget::TILE_MARGIN = 6;
-
 TileStoreWidget::TileStoreWidget(TileStore *tileStore)
     : tileStore(tileStore),
-      width(DEFAULT_WIDTH)
+      tileModel(new TileStoreModel(tileStore, DEFAULT_WIDTH, this)),
+      tileDelegate(new TileStoreDelegate(tileStore, this)),
+      selectedTile(-1),
+      restoringSelection(false)
 {
-    updateStore();
+    setModel(tileModel);
+    setItemDelegate(tileDelegate);
     horizontalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    updateSectionSizes();
 }
 
 int TileStoreWidget::selectedIndex()
 {
-    int index = -1;
-    auto selected = selectedIndexes();
-    if (selected.size() == 1) {
-        int row = selected.at(0).row();
-        int col = selected.at(0).column();
-        index = row*width + col;
-    }
-    if (index == -1 || index >= tileMapping.size()) {
-        return -1;
-    }
-    return tileMapping.at(index);
+    return selectedTile;
 }
 
 void TileStoreWidget::selectTile(int index)
 {
-    int tableIndex = -1;
-    for (int i = 0; i < tileMapping.size(); ++i) {
-        if (tileMapping.at(i) == index) {
-            tableIndex = i;
-            break;
-        }
-    }
-    if (tableIndex != -1) {
-        int row = tableIndex/width;
-        int col = tableIndex%width;
-        QModelIndex index = model()->index(row, col);
-        selectionModel()->select(index, QItemSelectionModel::Select);
+    QModelIndex modelIndex = tileModel->modelIndex(index);
+    if (modelIndex.isValid()) {
+        selectionModel()->setCurrentIndex(modelIndex, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Current);
     }
 }
 
 void TileStoreWidget::tileStoreChanged()
 {
-    updateStore();
+    tileModel->reset();
+    updateSectionSizes();
+    // Indices refer to a different set of tiles now
+    if (selectedTile != -1) {
+        selectedTile = -1;
+        emit itemSelectionChanged();
+    }
 }
 
 void TileStoreWidget::tileStoreWidthChanged(int width)
 {
-    this->width = width;
-    updateStore();
+    tileModel->setWidth(width);
+    restoreSelection();
 }
 
-void TileStoreWidget::updateStore()
+void TileStoreWidget::applyChanges(const TileChanges &changes)
 {
-    clear();
-    height = (tileStore->size() + width - 1)/width;
-    setRowCount(height);
-    setColumnCount(width);
-    tileMapping.clear();
-    int curPos = 0;
-    for (int i = 0; i < tileStore->size(); ++i) {
-        if (!tileStore->isHidden(i)) {
-            QTableWidgetItem *item = new QTableWidgetItem();
-            if (tileStore->getUseCount(i) == 0) {
-                item->setData(Qt::DecorationRole, QPixmap::fromImage(tileStore->getTile(i).getImage()));
-            } else {
-                QImage image = tileStore->getTile(i).getImage();
-                QImage usedImage(image.size(), QImage::Format_ARGB32);
-                usedImage.fill(Qt::transparent);
-                QPainter painter(&usedImage);
-                painter.setOpacity(USED_TILE_OPACITY);
-                painter.drawImage(QRect(0, 0, image.width(), image.height()), image);
-                item->setData(Qt::DecorationRole, QPixmap::fromImage(usedImage));
-            }
-            setItem(curPos/width, curPos%width, item);
-            curPos++;
-            tileMapping.append(i);
+    if (changes.allTiles) {
+        tileStoreChanged();
+        return;
+    }
+    if (changes.firstInserted != -1) {
+        tileModel->tilesInserted(changes.firstInserted);
+    }
+    if (!changes.removed.isEmpty()) {
+        tileModel->tilesRemoved();
+    }
+    // Cells following the first tile that appeared or disappeared have moved
+    if (!changes.visibility.isEmpty()) {
+        tileModel->visibilityChanged(changes.visibility.first());
+    }
+    foreach (int index, changes.useCounts) {
+        if (changes.visibility.isEmpty() || index < changes.visibility.first()) {
+            tileModel->useCountChanged(index);
         }
     }
-    horizontalHeader()->setDefaultSectionSize(tileStore->tileSize + TILE_MARGIN);
-    verticalHeader()->setDefaultSectionSize(tileStore->tileSize + TILE_MARGIN);
-    update();
+    if (!changes.removed.isEmpty() || !changes.visibility.isEmpty()) {
+        restoreSelection();
+    }
+}
+
+void TileStoreWidget::selectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
+{
+    QTableView::selectionChanged(selected, deselected);
+    if (restoringSelection) {
+        return;
+    }
+    auto indexes = selectedIndexes();
+    selectedTile = (indexes.size() == 1) ? tileModel->tileIndex(indexes.at(0)) : -1;
+    emit itemSelectionChanged();
+}
+
+void TileStoreWidget::updateSectionSizes()
+{
+    horizontalHeader()->setDefaultSectionSize(tileStore->tileSize + TileStoreDelegate::TILE_MARGIN);
+    verticalHeader()->setDefaultSectionSize(tileStore->tileSize + TileStoreDelegate::TILE_MARGIN);
+}
+
+void TileStoreWidget::restoreSelection()
+{
+    const QModelIndex modelIndex = tileModel->modelIndex(selectedTile);
+    restoringSelection = true;
+    if (modelIndex.isValid()) {
+        selectionModel()->setCurrentIndex(modelIndex, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Current);
+    } else {
+        clearSelection();
+    }
+    restoringSelection = false;
+    if (!modelIndex.isValid() && selectedTile != -1) {
+        selectedTile = -1;
+        emit itemSelectionChanged();
+    }
 }
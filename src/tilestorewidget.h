@@ -22,18 +22,19 @@
 
 #include <QObject>
 #include <QWidget>
-#include <QTableWidget>
-#include <QVector>
+#include <QTableView>
 
 #include "tilestore.h"
+#include "tilestoremodel.h"
+#include "tilestoredelegate.h"
+#include "updatescheduler.h"
 
-class TileStoreWidget : public QTableWidget
+class TileStoreWidget : public QTableView
 {
     Q_OBJECT
 
 public:
     static const int DEFAULT_WIDTH = 20;
-    static const int TILE_MARGIN;
 
     TileStoreWidget(TileStore *tileStore);
 
@@ -46,16 +47,31 @@ public:
 public slots:
     void tileStoreChanged();
     void tileStoreWidthChanged(int width);
+    void applyChanges(const TileChanges &changes);
 
-private:
-    static const double USED_TILE_OPACITY;
+signals:
+    void itemSelectionChanged();
+
+protected:
+    void selectionChanged(const QItemSelection &selected, const QItemSelection &deselected) override;
 
+private:
     TileStore *tileStore;
-    QVector<int> tileMapping;
-    int width;
-    int height;
+    TileStoreModel *tileModel;
+    TileStoreDelegate *tileDelegate;
+    //
+    // Selection is tracked by tile, since cells shift when tiles are hidden,
+    // shown or removed
+    //
+    int selectedTile;
+    bool restoringSelection;
 
-    void updateStore();
+    void updateSectionSizes();
+    //
+    // Select the cell the selected tile has moved to, or clear the selection
+    // if the tile is no longer visible
+    //
+    void restoreSelection();
 };
 
 #endif // TILESTOREWIDGET_H
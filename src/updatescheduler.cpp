@@ -0,0 +1,113 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "updatescheduler.h"
+
+#include <QTimer>
+#include <algorithm>
+
+UpdateScheduler::UpdateScheduler(QObject *parent)
+    : QObject(parent),
+      pending(false),
+      allTiles(false),
+      firstInserted(-1)
+{
+}
+
+void UpdateScheduler::useCountsChanged(const QVector<int> &indices)
+{
+    foreach (int index, indices) {
+        useCounts.insert(index);
+    }
+    schedule();
+}
+
+void UpdateScheduler::visibilityChanged(int index)
+{
+    visibility.insert(index);
+    schedule();
+}
+
+void UpdateScheduler::allTilesChanged()
+{
+    allTiles = true;
+    schedule();
+}
+
+void UpdateScheduler::tilesInserted(int first, int)
+{
+    if (firstInserted == -1 || first < firstInserted) {
+        firstInserted = first;
+    }
+    schedule();
+}
+
+void UpdateScheduler::tilesRemoved(const QVector<int> &indices)
+{
+    foreach (int index, indices) {
+        removed.insert(index);
+    }
+    schedule();
+}
+
+void UpdateScheduler::cellChanged(QPoint cell)
+{
+    if (!cells.contains(cell)) {
+        cells.append(cell);
+    }
+    schedule();
+}
+
+void UpdateScheduler::flush()
+{
+    TileChanges changes;
+    changes.allTiles = allTiles;
+    changes.firstInserted = firstInserted;
+    changes.removed = sorted(removed);
+    changes.useCounts = sorted(useCounts);
+    changes.visibility = sorted(visibility);
+    changes.cells = cells;
+    pending = false;
+    allTiles = false;
+    firstInserted = -1;
+    removed.clear();
+    useCounts.clear();
+    visibility.clear();
+    cells.clear();
+    emit changesReady(changes);
+}
+
+void UpdateScheduler::schedule()
+{
+    if (!pending) {
+        pending = true;
+        QTimer::singleShot(0, this, SLOT(flush()));
+    }
+}
+
+QVector<int> UpdateScheduler::sorted(const QSet<int> &indices)
+{
+    QVector<int> result;
+    result.reserve(indices.size());
+    foreach (int index, indices) {
+        result.append(index);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
@@ -0,0 +1,91 @@
+/*
+  Copyright 2020 Bundesamt fuer Sicherheit in der Informationstechnik (BSI)
+
+  This file is part of RdpCacheStitcher.
+
+  RdpCacheStitcher is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  RdpCacheStitcher is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with RdpCacheStitcher.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+#include <QObject>
+#include <QSet>
+#include <QVector>
+#include <QPoint>
+
+//
+// Changes collected during one turn of the event loop
+//
+struct TileChanges {
+    //
+    // The set of available tiles changed as a whole
+    //
+    bool allTiles = false;
+    //
+    // First index of appended tiles, or -1
+    //
+    int firstInserted = -1;
+    //
+    // Tile indices, sorted and without duplicates
+    //
+    QVector<int> removed;
+    QVector<int> useCounts;
+    QVector<int> visibility;
+    //
+    // Changed cells of the current screen, in grid coordinates
+    //
+    QVector<QPoint> cells;
+};
+
+//
+// Collects change notifications of the tile store and the screen and hands
+// them to the widgets in one batch per event loop turn, so each of them
+// does its work once per user action.
+//
+class UpdateScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    UpdateScheduler(QObject *parent = 0);
+
+public slots:
+    void useCountsChanged(const QVector<int> &indices);
+    void visibilityChanged(int index);
+    void allTilesChanged();
+    void tilesInserted(int first, int last);
+    void tilesRemoved(const QVector<int> &indices);
+    void cellChanged(QPoint cell);
+
+signals:
+    void changesReady(const TileChanges &changes);
+
+private slots:
+    void flush();
+
+private:
+    bool pending;
+    bool allTiles;
+    int firstInserted;
+    QSet<int> removed;
+    QSet<int> useCounts;
+    QSet<int> visibility;
+    QVector<QPoint> cells;
+
+    void schedule();
+    static QVector<int> sorted(const QSet<int> &indices);
+};
+
+#endif // UPDATESCHEDULER_H